@@ -1,4 +1,164 @@
 
+#ifndef BLOCKALLOCATOR_H
+#define BLOCKALLOCATOR_H
+
+#include <cstddef>
+
+/* ALLOCATOR POLICIES
+ * NumberlikeArray gets the arrays for values that don't fit inline from an
+ * allocator policy: a class with
+ *
+ *     static void *allocate(std::size_t bytes);
+ *     static void deallocate(void *p);
+ *
+ * whose memory is aligned for any block type.  BlockPoolAllocator is the
+ * default; NewDeleteAllocator is the plain one. */
+
+// Plain operator new and operator delete
+class NewDeleteAllocator {
+public:
+	static void *allocate(std::size_t bytes) { return ::operator new(bytes); }
+	static void deallocate(void *p) { ::operator delete(p); }
+};
+
+/* A BlockArena hands out memory by bumping a pointer through big chunks and
+ * takes it all back at once with reset, so a batch of numbers that die
+ * together costs no frees at all.  Freeing the most recent allocation gives
+ * its memory back straight away, which keeps short-lived temporaries from
+ * piling up; freeing anything else does nothing until the reset.
+ *
+ * An arena is used through BlockPoolAllocator: while a BlockArena::Scope is
+ * alive, every allocation on its thread comes from the scope's arena.
+ * Everything allocated from an arena must be destroyed before it is reset
+ * or destroyed itself.  An arena must only be used by one thread at a
+ * time. */
+class BlockArena {
+
+public:
+	// Chunks are at least this big; bigger requests get a chunk of their own.
+	explicit BlockArena(std::size_t chunkBytes = 1 << 18);
+	~BlockArena();
+
+	void *allocate(std::size_t bytes);
+	// Only does something for the most recent allocation, of the given size.
+	void deallocate(void *p, std::size_t bytes);
+	/* Makes all the memory available again.  The chunks are kept for
+	 * reuse; the destructor frees them. */
+	void reset();
+
+	// The arena that is current on this thread, or NULL
+	static BlockArena *getCurrent() { return current; }
+
+	/* Makes an arena current on this thread for the lifetime of the Scope.
+	 * Scopes nest: the previous arena (or none) is current again after. */
+	class Scope {
+		BlockArena *previous;
+		Scope(const Scope &);
+		void operator =(const Scope &);
+	public:
+		explicit Scope(BlockArena &arena) : previous(current) {
+			current = &arena;
+		}
+		~Scope() { current = previous; }
+	};
+
+	/* Makes no arena current on this thread for the lifetime of the Pause,
+	 * so that numbers built inside a Scope can outlive its arena.  The
+	 * previous arena is current again after. */
+	class Pause {
+		BlockArena *previous;
+		Pause(const Pause &);
+		void operator =(const Pause &);
+	public:
+		Pause() : previous(current) {
+			current = NULL;
+		}
+		~Pause() { current = previous; }
+	};
+
+protected:
+	// Each chunk starts with this header; its memory follows.
+	struct Chunk {
+		Chunk *next;
+		std::size_t bytes;
+	};
+	std::size_t chunkBytes;
+	// All the chunks, in the order they are used
+	Chunk *first;
+	// The chunk being used, and the free part of it
+	Chunk *chunk;
+	char *top, *end;
+
+	enum { alignment = 16 };
+	static std::size_t roundUp(std::size_t bytes) {
+		return (bytes + alignment - 1) & ~std::size_t(alignment - 1);
+	}
+	static char *chunkStart(Chunk *c) {
+		return reinterpret_cast<char *>(c) + roundUp(sizeof(Chunk));
+	}
+	// Makes c the chunk being used.
+	void useChunk(Chunk *c);
+
+	static thread_local BlockArena *current;
+
+private:
+	// Arenas can't be copied.
+	BlockArena(const BlockArena &);
+	void operator =(const BlockArena &);
+};
+
+/* The default allocator policy: a pool of size classes per thread.
+ * Requests are rounded up to a power of two; a freed array goes on the
+ * freeing thread's list for its size and serves the next request of that
+ * size, so a steady mix of allocations and frees rarely reaches the system
+ * allocator, and threads never contend for a lock.  Each list keeps at most
+ * maxCachedPerClass arrays, and requests over 2^maxClassBits bytes go
+ * straight to operator new.
+ *
+ * If a BlockArena is current on the thread, requests come from it instead.
+ * A small header in front of each array records where it came from, so it
+ * goes back to the right place whichever way it was allocated. */
+class BlockPoolAllocator {
+
+public:
+	enum {
+		// Size classes run from 2^minClassBits to 2^maxClassBits bytes.
+		minClassBits = 6,
+		maxClassBits = 16,
+		numClasses = maxClassBits - minClassBits + 1,
+		maxCachedPerClass = 64
+	};
+
+	static void *allocate(std::size_t bytes);
+	static void deallocate(void *p);
+
+protected:
+	/* The header: the size class (or one of the tags below), the size of
+	 * the whole allocation, and the arena it came from if any.  Its size
+	 * keeps the array after it aligned. */
+	union Header {
+		struct {
+			std::size_t sizeClass;
+			std::size_t bytes;
+			BlockArena *arena;
+		} info;
+		long double alignment[2];
+	};
+	enum { largeTag = numClasses, arenaTag = numClasses + 1 };
+
+	// The free lists of one thread, threaded through the freed arrays
+	struct FreeLists {
+		Header *heads[numClasses];
+		unsigned int counts[numClasses];
+		FreeLists();
+		// Returns the cached arrays to the system when the thread ends.
+		~FreeLists();
+	};
+	static thread_local FreeLists freeLists;
+};
+
+#endif
+
 #ifndef NUMBERLIKEARRAY_H
 #define NUMBERLIKEARRAY_H
 
@@ -7,8 +167,21 @@
 #define NULL 0
 #endif
 
-/* A NumberlikeArray<Blk> object holds a heap-allocated array of Blk with a
- * length and a capacity and provides basic memory management features.
+#include <utility>
+
+/* The number of blocks a NumberlikeArray holds inside the object itself.
+ * Values up to this long never touch the heap; longer ones are allocated
+ * as before.  It must be at least 1.  The default covers a product of two
+ * 2048-bit numbers in 64-bit blocks (or of two 1024-bit ones in 32-bit
+ * blocks) at the cost of a bigger object. */
+#ifndef NUMBERLIKEARRAY_INLINE_BLOCKS
+#define NUMBERLIKEARRAY_INLINE_BLOCKS 64
+#endif
+
+/* A NumberlikeArray<Blk> object holds an array of Blk with a length and a
+ * capacity and provides basic memory management features.  The array is
+ * inside the object up to NUMBERLIKEARRAY_INLINE_BLOCKS blocks and comes
+ * from the Allocator policy (see BlockAllocator above) beyond that.
  * BigUnsigned and BigUnsignedInABase both subclass it.
  *
  * NumberlikeArray provides no information hiding.  Subclasses should use
@@ -18,7 +191,7 @@
  * public:
  *     NumberlikeArray< the-type-argument >::getLength;
  */
-template <class Blk>
+template <class Blk, class Allocator = BlockPoolAllocator>
 class NumberlikeArray {
 public:
 
@@ -27,29 +200,49 @@ public:
 	// The number of bits in a block, defined below.
 	static const unsigned int N;
 
+	// The number of blocks stored inside the object
+	static const Index inlineCap = NUMBERLIKEARRAY_INLINE_BLOCKS;
+
 	// The current allocated capacity of this NumberlikeArray (in blocks)
 	Index cap;
 	// The actual length of the value stored in this NumberlikeArray (in blocks)
 	Index len;
-	// Heap-allocated array of the blocks (can be NULL if len == 0)
+	// The array of the blocks: either inlineBlk or a heap-allocated array
 	Blk *blk;
+	// Storage for short values
+	Blk inlineBlk[NUMBERLIKEARRAY_INLINE_BLOCKS];
+
+	// Whether the blocks are on the heap
+	bool isOnHeap() const { return blk != inlineBlk; }
+
+	// Gets and returns heap arrays of blocks through the Allocator.
+	static Blk *newBlocks(Index c) {
+		return static_cast<Blk *>(Allocator::allocate(c * sizeof(Blk)));
+	}
+	static void deleteBlocks(Blk *b) { Allocator::deallocate(b); }
 
 	// Constructs a ``zero'' NumberlikeArray with the given capacity.
-	NumberlikeArray(Index c) : cap(c), len(0) { 
-		blk = (cap > 0) ? (new Blk[cap]) : NULL;
+	NumberlikeArray(Index c) : len(0) { 
+		if (c > inlineCap) {
+			cap = c;
+			blk = newBlocks(cap);
+		} else {
+			cap = inlineCap;
+			blk = inlineBlk;
+		}
 	}
 
-	/* Constructs a zero NumberlikeArray without allocating a backing array.
-	 * A subclass that doesn't know the needed capacity at initialization
-	 * time can use this constructor and then overwrite blk without first
-	 * deleting it. */
-	NumberlikeArray() : cap(0), len(0) {
-		blk = NULL;
+	/* Constructs a zero NumberlikeArray using the inline storage.  A
+	 * subclass that doesn't know the needed capacity at initialization
+	 * time can use this constructor and then call allocate. */
+	NumberlikeArray() : cap(inlineCap), len(0) {
+		blk = inlineBlk;
 	}
 
-	// Destructor.  Note that `delete NULL' is a no-op.
+	// Destructor.
 	~NumberlikeArray() {
-		delete [] blk;
+		if (isOnHeap())
+			deleteBlocks(blk);
 	}
 
 	/* Ensures that the array has at least the requested capacity; may
@@ -61,14 +254,24 @@ public:
 	void allocateAndCopy(Index c);
 
 	// Copy constructor
-	NumberlikeArray(const NumberlikeArray<Blk> &x);
+	NumberlikeArray(const NumberlikeArray<Blk, Allocator> &x);
 
 	// Assignment operator
-	void operator=(const NumberlikeArray<Blk> &x);
+	void operator=(const NumberlikeArray<Blk, Allocator> &x);
+
+	/* Move constructor and move assignment: take over x's heap array
+	 * instead of copying it.  (Inline blocks have to be copied.)  x is left
+	 * as zero. */
+	NumberlikeArray(NumberlikeArray<Blk, Allocator> &&x);
+	void operator=(NumberlikeArray<Blk, Allocator> &&x);
 
 	// Constructor that copies from a given array of blocks
 	NumberlikeArray(const Blk *b, Index blen);
 
+	/* Exchanges contents with x.  Heap arrays change hands without
+	 * copying; inline blocks are copied. */
+	void swap(NumberlikeArray<Blk, Allocator> &x);
+
 	// ACCESSORS
 	Index getCapacity()     const { return cap;      }
 	Index getLength()       const { return len;      }
@@ -78,9 +281,9 @@ public:
 	/* Equality comparison: checks if both objects have the same length and
 	 * equal (==) array elements to that length.  Subclasses may wish to
 	 * override. */
-	bool operator ==(const NumberlikeArray<Blk> &x) const;
+	bool operator ==(const NumberlikeArray<Blk, Allocator> &x) const;
 
-	bool operator !=(const NumberlikeArray<Blk> &x) const {
+	bool operator !=(const NumberlikeArray<Blk, Allocator> &x) const {
 		return !operator ==(x);
 	}
 };
@@ -88,52 +291,94 @@ public:
 /* BEGIN TEMPLATE DEFINITIONS.  They are present here so that source files that
  * include this header file can generate the necessary real definitions. */
 
-template <class Blk>
-const unsigned int NumberlikeArray<Blk>::N = 8 * sizeof(Blk);
+template <class Blk, class Allocator>
+const unsigned int NumberlikeArray<Blk, Allocator>::N = 8 * sizeof(Blk);
 
-template <class Blk>
-void NumberlikeArray<Blk>::allocate(Index c) {
+template <class Blk, class Allocator>
+const typename NumberlikeArray<Blk, Allocator>::Index NumberlikeArray<Blk, Allocator>::inlineCap;
+
+/* Since the capacity never drops below inlineCap, growing always means
+ * moving to the heap. */
+template <class Blk, class Allocator>
+void NumberlikeArray<Blk, Allocator>::allocate(Index c) {
 	// If the requested capacity is more than the current capacity...
 	if (c > cap) {
 		// Delete the old number array
-		delete [] blk;
+		if (isOnHeap())
+			deleteBlocks(blk);
 		// Allocate the new array
 		cap = c;
-		blk = new Blk[cap];
+		blk = newBlocks(cap);
 	}
 }
 
-template <class Blk>
-void NumberlikeArray<Blk>::allocateAndCopy(Index c) {
+template <class Blk, class Allocator>
+void NumberlikeArray<Blk, Allocator>::allocateAndCopy(Index c) {
 	// If the requested capacity is more than the current capacity...
 	if (c > cap) {
 		Blk *oldBlk = blk;
 		// Allocate the new number array
 		cap = c;
-		blk = new Blk[cap];
+		blk = newBlocks(cap);
 		// Copy number blocks
 		Index i;
 		for (i = 0; i < len; i++)
 			blk[i] = oldBlk[i];
 		// Delete the old array
-		delete [] oldBlk;
+		if (oldBlk != inlineBlk)
+			deleteBlocks(oldBlk);
 	}
 }
 
-template <class Blk>
-NumberlikeArray<Blk>::NumberlikeArray(const NumberlikeArray<Blk> &x)
-		: len(x.len) {
-	// Create array
-	cap = len;
-	blk = new Blk[cap];
+template <class Blk, class Allocator>
+NumberlikeArray<Blk, Allocator>::NumberlikeArray(const NumberlikeArray<Blk, Allocator> &x)
+		: cap(inlineCap), len(x.len), blk(inlineBlk) {
+	// Create array if the blocks don't fit inline
+	if (len > cap) {
+		cap = len;
+		blk = newBlocks(cap);
+	}
 	// Copy blocks
 	Index i;
 	for (i = 0; i < len; i++)
 		blk[i] = x.blk[i];
 }
 
-template <class Blk>
-void NumberlikeArray<Blk>::operator=(const NumberlikeArray<Blk> &x) {
+template <class Blk, class Allocator>
+NumberlikeArray<Blk, Allocator>::NumberlikeArray(NumberlikeArray<Blk, Allocator> &&x)
+		: cap(inlineCap), len(x.len), blk(inlineBlk) {
+	if (x.isOnHeap()) {
+		// Take the array and leave x with its inline storage.
+		cap = x.cap;
+		blk = x.blk;
+		x.cap = inlineCap;
+		x.blk = x.inlineBlk;
+	} else
+		for (Index i = 0; i < len; i++)
+			blk[i] = x.blk[i];
+	x.len = 0;
+}
+
+template <class Blk, class Allocator>
+void NumberlikeArray<Blk, Allocator>::operator=(NumberlikeArray<Blk, Allocator> &&x) {
+	if (this == &x)
+		return;
+	if (x.isOnHeap()) {
+		if (isOnHeap())
+			deleteBlocks(blk);
+		cap = x.cap;
+		blk = x.blk;
+		len = x.len;
+		x.cap = inlineCap;
+		x.blk = x.inlineBlk;
+	} else
+		// The blocks fit inline, so they fit here without allocating.
+		operator =(static_cast<const NumberlikeArray<Blk, Allocator> &>(x));
+	x.len = 0;
+}
+
+template <class Blk, class Allocator>
+void NumberlikeArray<Blk, Allocator>::operator=(const NumberlikeArray<Blk, Allocator> &x) {
 	/* Calls like a = a have no effect; catch them before the aliasing
 	 * causes a problem */
 	if (this == &x)
@@ -148,19 +393,56 @@ void NumberlikeArray<Blk>::operator=(const NumberlikeArray<Blk> &x) {
 		blk[i] = x.blk[i];
 }
 
-template <class Blk>
-NumberlikeArray<Blk>::NumberlikeArray(const Blk *b, Index blen)
-		: cap(blen), len(blen) {
-	// Create array
-	blk = new Blk[cap];
+template <class Blk, class Allocator>
+NumberlikeArray<Blk, Allocator>::NumberlikeArray(const Blk *b, Index blen)
+		: cap(inlineCap), len(blen), blk(inlineBlk) {
+	// Create array if the blocks don't fit inline
+	if (len > cap) {
+		cap = len;
+		blk = newBlocks(cap);
+	}
 	// Copy blocks
 	Index i;
 	for (i = 0; i < len; i++)
 		blk[i] = b[i];
 }
 
-template <class Blk>
-bool NumberlikeArray<Blk>::operator ==(const NumberlikeArray<Blk> &x) const {
+template <class Blk, class Allocator>
+void NumberlikeArray<Blk, Allocator>::swap(NumberlikeArray<Blk, Allocator> &x) {
+	Index tempLen = len, i;
+	if (isOnHeap() && x.isOnHeap()) {
+		Index tempCap = cap;
+		Blk *tempBlk = blk;
+		cap = x.cap;
+		blk = x.blk;
+		x.cap = tempCap;
+		x.blk = tempBlk;
+	} else if (!isOnHeap() && !x.isOnHeap()) {
+		Index n = (len > x.len) ? len : x.len;
+		for (i = 0; i < n; i++) {
+			Blk temp = blk[i];
+			blk[i] = x.blk[i];
+			x.blk[i] = temp;
+		}
+	} else {
+		// The inline blocks move into the other object's inline storage.
+		NumberlikeArray<Blk, Allocator> &h = isOnHeap() ? *this : x;
+		NumberlikeArray<Blk, Allocator> &in = isOnHeap() ? x : *this;
+		Blk *heapBlk = h.blk;
+		Index heapCap = h.cap;
+		for (i = 0; i < in.len; i++)
+			h.inlineBlk[i] = in.blk[i];
+		h.blk = h.inlineBlk;
+		h.cap = inlineCap;
+		in.blk = heapBlk;
+		in.cap = heapCap;
+	}
+	len = x.len;
+	x.len = tempLen;
+}
+
+template <class Blk, class Allocator>
+bool NumberlikeArray<Blk, Allocator>::operator ==(const NumberlikeArray<Blk, Allocator> &x) const {
 	if (len != x.len)
 		// Definitely unequal.
 		return false;
@@ -180,6 +462,15 @@ bool NumberlikeArray<Blk>::operator ==(const NumberlikeArray<Blk> &x) const {
 #ifndef BIGUNSIGNED_H
 #define BIGUNSIGNED_H
 
+#include <cstring>
+
+/* With GCC on x86-64 the carry kernels use the add-with-carry intrinsics
+ * and an ADX multiply-add loop; elsewhere they fall back to portable C++. */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BIGUNSIGNED_X86_CARRY
+#include <immintrin.h>
+#endif
+
 /* A BigUnsigned object represents a nonnegative integer of size limited only by
  * available memory.  BigUnsigneds support most mathematical operators and can
  * be converted to and from most primitive integer types.
@@ -201,7 +492,7 @@ public:
 
 protected:
 	// Creates a BigUnsigned with a capacity; for internal use.
-	BigUnsigned(int, Index c) : NumberlikeArray<Blk>(0, c) {}
+	BigUnsigned(int, Index c) : NumberlikeArray<Blk>(c) {}
 
 	// Decreases len to eliminate any leading zero blocks.
 	void zapLeadingZeros() { 
@@ -209,6 +500,9 @@ protected:
 			len--;
 	}
 
+	// Adds the nx blocks of x to *this in place; x must not be in *this.
+	void accumulate(const Blk *x, Index nx);
+
 public:
 	// Constructs zero.
 	BigUnsigned() : NumberlikeArray<Blk>() {}
@@ -221,6 +515,17 @@ public:
 		NumberlikeArray<Blk>::operator =(x);
 	}
 
+	// Move constructor and move assignment; x is left as zero.
+	BigUnsigned(BigUnsigned &&x) : NumberlikeArray<Blk>(std::move(x)) {}
+	void operator=(BigUnsigned &&x) {
+		NumberlikeArray<Blk>::operator =(std::move(x));
+	}
+
+	// Exchanges values with x in constant time
+	void swap(BigUnsigned &x) {
+		NumberlikeArray<Blk>::swap(x);
+	}
+
 	// Constructor that copies from a given array of blocks.
 	BigUnsigned(const Blk *b, Index blen) : NumberlikeArray<Blk>(b, blen) {
 		// Eliminate any leading zeros we may have been passed.
@@ -258,6 +563,15 @@ protected:
 	template <class X> X convertToPrimitive      () const;
 public:
 
+	/* CONVERSION TO AND FROM BYTES
+	 * Bytes are big-endian: the most significant byte comes first.
+	 * fromBytesBE reads the number in the n bytes at bytes.  toBytesBE
+	 * writes the number mod 256^n to the n bytes at bytes, padding with
+	 * leading zeros.  Both go a block at a time and allocate nothing for
+	 * numbers that fit inline. */
+	static BigUnsigned fromBytesBE(const unsigned char *bytes, std::size_t n);
+	void toBytesBE(unsigned char *bytes, std::size_t n) const;
+
 	// BIT/BLOCK ACCESSORS
 
 	// Expose these from NumberlikeArray directly.
@@ -355,6 +669,22 @@ public:
 	void add(const BigUnsigned &a, const BigUnsigned &b);
 	void subtract(const BigUnsigned &a, const BigUnsigned &b);
 	void multiply(const BigUnsigned &a, const BigUnsigned &b);
+	/* Like multiply(a, a), but each cross product a[i] * a[j] is computed
+	 * once and doubled.  `x.square(x)' is handled without the temporary
+	 * copy that aliased calls normally make. */
+	void square(const BigUnsigned &a);
+	/* *this = a * b + c and *this = (a * b) % m without a temporary for
+	 * the product, which is made in *this and added to or reduced where
+	 * it lies; the reduction keeps no quotient.  When a or b is a single
+	 * block, a * b + c is one pass that reads each block of a and c just
+	 * before writing the same block of *this, so `x.multiplyAdd(x, 10, d)'
+	 * works in place; `s.multiplyAdd(p, y, s)' adds the product into s
+	 * row by row, or by way of a pooled block buffer once the factors are
+	 * long enough for Karatsuba. */
+	void multiplyAdd(const BigUnsigned &a, const BigUnsigned &b,
+			const BigUnsigned &c);
+	void multiplyModulo(const BigUnsigned &a, const BigUnsigned &b,
+			const BigUnsigned &m);
 	void bitAnd(const BigUnsigned &a, const BigUnsigned &b);
 	void bitOr(const BigUnsigned &a, const BigUnsigned &b);
 	void bitXor(const BigUnsigned &a, const BigUnsigned &b);
@@ -374,6 +704,30 @@ public:
 	/* `divide' and `modulo' are no longer offered.  Use
 	 * `divideWithRemainder' instead. */
 
+	/* `multiply' switches from the schoolbook method to Karatsuba's once
+	 * both operands are at least this many blocks long.  The default is
+	 * BIGUNSIGNED_KARATSUBA_THRESHOLD; it can be changed at run time to
+	 * tune for a particular machine.  Values below 4 are treated as 4. */
+	static Index karatsubaThreshold;
+	/* Likewise, balanced products and squares of at least this many blocks
+	 * use Toom-3 instead of Karatsuba.  The default is
+	 * BIGUNSIGNED_TOOM3_THRESHOLD.  Values below 8 are treated as 8. */
+	static Index toom3Threshold;
+	/* Products and squares whose shorter operand has at least this many
+	 * blocks use a number-theoretic transform, which takes O(n log n)
+	 * time.  The default is BIGUNSIGNED_NTT_THRESHOLD.  Values below 64
+	 * are treated as 64.  The transform needs 64-bit blocks; with shorter
+	 * ones it is never used. */
+	static Index nttThreshold;
+	/* `divideWithRemainder' multiplies by a reciprocal of the divisor,
+	 * found with Newton's iteration, instead of dividing block by block
+	 * once both the divisor and the quotient are at least this many
+	 * blocks long.  That takes a constant number of multiplications, so it
+	 * pays once those are subquadratic.  The default is
+	 * BIGUNSIGNED_NEWTON_DIVISION_THRESHOLD.  Values below 4 are treated
+	 * as 4. */
+	static Index newtonDivisionThreshold;
+
 	// OVERLOADED RETURN-BY-VALUE OPERATORS
 	BigUnsigned operator +(const BigUnsigned &x) const;
 	BigUnsigned operator -(const BigUnsigned &x) const;
@@ -412,9 +766,182 @@ public:
 	friend Blk getShiftedBlock(const BigUnsigned &num, Index x,
 			unsigned int y);
 
+protected:
+	/* BLOCK KERNELS
+	 * These work directly on arrays of blocks, least significant first, and
+	 * do no allocation.  The copy-less operations are built on them. */
+
+	/* Returns the low block of the double-width product a * b and stores
+	 * the high block in hi. */
+	static Blk mulBlk(Blk a, Blk b, Blk &hi);
+	/* Adds a * b to the three-block accumulator (c2, c1, c0).  The
+	 * accumulator is what product scanning carries from column to column. */
+	static void mulAccBlk(Blk a, Blk b, Blk &c0, Blk &c1, Blk &c2);
+	/* Return a + b + carry and a - b - borrow, and set carry or borrow
+	 * (0 or 1) to what comes out the top.  No branches. */
+	static Blk addCarryBlk(Blk a, Blk b, Blk &carry);
+	static Blk subBorrowBlk(Blk a, Blk b, Blk &borrow);
+	/* Returns the low block of a * b + c + carry and sets carry to the
+	 * high block.  The sum always fits in two blocks. */
+	static Blk mulAddBlk(Blk a, Blk b, Blk c, Blk &carry);
+	/* Returns the block quotient of the two-block number (hi, lo) by d and
+	 * stores the remainder in rem.  The top bit of d must be set and hi
+	 * must be less than d, so that the quotient fits in a block. */
+	static Blk divBlk(Blk hi, Blk lo, Blk d, Blk &rem);
+	/* Stores the na + nb blocks of a * b in r, which must not overlap a or
+	 * b.  Both na and nb must be positive. */
+	static void multiplyBlocksBasecase(Blk *r, const Blk *a, Index na,
+			const Blk *b, Index nb);
+	/* Same as multiplyBlocksBasecase, but picks the algorithm by operand
+	 * size.  scratch must hold multiplyScratchSize(na, nb) blocks. */
+	static void multiplyBlocks(Blk *r, const Blk *a, Index na,
+			const Blk *b, Index nb, Blk *scratch);
+	static Index multiplyScratchSize(Index na, Index nb);
+	/* Karatsuba multiplication of two n-block operands into 2n blocks.
+	 * Operands of toom3Threshold blocks or more go to toom3Blocks. */
+	static void karatsubaBlocks(Blk *r, const Blk *a, const Blk *b, Index n,
+			Blk *scratch);
+	static Index karatsubaScratchSize(Index n);
+	// Toom-3 multiplication of two n-block operands into 2n blocks.
+	static void toom3Blocks(Blk *r, const Blk *a, const Blk *b, Index n,
+			Blk *scratch);
+	static Index toom3ScratchSize(Index n);
+	// The squaring counterparts of the above; r gets 2n blocks.
+	static void squareBlocksBasecase(Blk *r, const Blk *a, Index n);
+	static void squareBlocks(Blk *r, const Blk *a, Index n, Blk *scratch);
+	static Index squareScratchSize(Index n);
+	static void toom3SquareBlocks(Blk *r, const Blk *a, Index n,
+			Blk *scratch);
+	static Index toom3SquareScratchSize(Index n);
+	static Index effectiveKaratsubaThreshold() {
+		return karatsubaThreshold < 4 ? 4 : karatsubaThreshold;
+	}
+	static Index effectiveToom3Threshold() {
+		return toom3Threshold < 8 ? 8 : toom3Threshold;
+	}
+	static Index effectiveNTTThreshold() {
+		if (N < 64)
+			return ~Index(0);
+		return nttThreshold < 64 ? 64 : nttThreshold;
+	}
+	static Index effectiveNewtonDivisionThreshold() {
+		return newtonDivisionThreshold < 4 ? 4 : newtonDivisionThreshold;
+	}
+	/* Toom-3 evaluation and interpolation helpers; see the Toom-3 section
+	 * of BigUnsigned.cc. */
+	static bool toom3Evaluate(Blk *p1, Blk *pm1, Blk *pm2, bool &negM2,
+			const Blk *a, Index k, Index h);
+	static void toom3Interpolate(Blk *r, Index n, Index k, Blk *r1,
+			Blk *rm1, bool negM1, Blk *rm2, bool negM2);
+	/* Multiplication by number-theoretic transforms modulo three primes
+	 * just below 2^62, recombined with the Chinese remainder theorem.
+	 * Stores the na + nb blocks of a * b in r, which must not overlap a or
+	 * b.  Passing the same operand twice squares it with two transforms
+	 * fewer.  scratch must hold nttScratchSize(na, nb) blocks. */
+	static void nttMultiplyBlocks(Blk *r, const Blk *a, Index na,
+			const Blk *b, Index nb, Blk *scratch);
+	static Index nttScratchSize(Index na, Index nb);
+	/* Arithmetic modulo one of the transform primes p, in Montgomery form
+	 * with R = 2^64.  p < 2^62, so the transforms can let values run up
+	 * to 2p and reduce them only when they would pass it. */
+	struct NTTPrime {
+		Blk p;    // The prime, c * 2^k + 1
+		Blk twoP; // 2p
+		Blk pInv; // -p^(-1) mod 2^64
+		Blk one;  // R mod p
+		Blk rr;   // R^2 mod p
+		Blk root; // A primitive root mod p
+		explicit NTTPrime(Blk p, Blk root);
+		/* a b R^(-1) mod p, for a b < p R.  mulLazy leaves the result
+		 * below 2p, and mul below p. */
+		Blk mulLazy(Blk a, Blk b) const;
+		Blk mul(Blk a, Blk b) const {
+			Blk t = mulLazy(a, b);
+			return t >= p ? t - p : t;
+		}
+		// (a + b) mod p and (a - b) mod p, for a and b less than p
+		Blk add(Blk a, Blk b) const { a += b; return a >= p ? a - p : a; }
+		Blk sub(Blk a, Blk b) const { return a >= b ? a - b : a + p - b; }
+		// x^e R mod p, for x in Montgomery form
+		Blk pow(Blk x, Blk e) const;
+	};
+	/* Fills the len blocks at w with the twiddle factors for a transform
+	 * of length len: w[h + j] is the j-th power of a root of unity of
+	 * order 2h, in Montgomery form, for each power of two h < len. */
+	static void nttTwiddles(const NTTPrime &f, Blk *w, Index len);
+	/* The forward transform leaves its output in bit-reversed order and
+	 * the inverse takes its input that way, so neither reorders. */
+	static void nttForward(const NTTPrime &f, Blk *x, Index len,
+			const Blk *w);
+	static void nttInverse(const NTTPrime &f, Blk *x, Index len,
+			const Blk *w);
+
+	/* r = a + b and r = a - b over n blocks, returning the carry or borrow
+	 * out of the top block.  r may be the same array as a or b. */
+	static Blk addBlocks(Blk *r, const Blk *a, const Blk *b, Index n);
+	static Blk subBlocks(Blk *r, const Blk *a, const Blk *b, Index n);
+	/* Adds (subtracts) c to (from) the n blocks of r in place, returning
+	 * the carry (borrow) out of the top block. */
+	static Blk addBlockToBlocks(Blk *r, Index n, Blk c);
+	static Blk subBlockFromBlocks(Blk *r, Index n, Blk c);
+	/* Adds a * m to the n blocks of r in place and returns the block
+	 * carried out of the top. */
+	static Blk mulAddBlocks(Blk *r, const Blk *a, Index n, Blk m);
+#ifdef BIGUNSIGNED_X86_CARRY
+	/* mulAddBlocks as a mulx loop that keeps two carry chains in flight
+	 * with adcx and adox.  Requires n >= 1 and a CPU with BMI2 and ADX,
+	 * which haveADX reports. */
+	static Blk mulAddBlocksADX(Blk *r, const Blk *a, Index n, Blk m);
+	static bool haveADX();
+#endif
+	// Subtracts a * m from the n blocks of r in place and returns the borrow.
+	static Blk mulSubBlocks(Blk *r, const Blk *a, Index n, Blk m);
+	// Compares two n-block arrays like compareTo.
+	static CmpRes compareBlocks(const Blk *a, const Blk *b, Index n);
+	/* Stores |x - y| in the first nx blocks of r and returns true if
+	 * x < y.  Requires nx >= ny; y is treated as zero-extended.  r may be
+	 * the same array as x or y. */
+	static bool absDiffBlocks(Blk *r, const Blk *x, Index nx,
+			const Blk *y, Index ny);
+	/* Adds the signed values (negX ? -x : x) and (negY ? -y : y), storing
+	 * the magnitude in the first nx blocks of r and returning true if the
+	 * sum is negative.  Requires nx >= ny, and the magnitude must fit in
+	 * nx blocks.  r may be the same array as x or y. */
+	static bool addSignedBlocks(Blk *r, const Blk *x, Index nx, bool negX,
+			const Blk *y, Index ny, bool negY);
+	/* Divides the n blocks of r in place by 3, which must divide them
+	 * exactly. */
+	static void divExactBy3Blocks(Blk *r, Index n);
+
+	/* Sets *this to floor(B^(2p) / d) or one less, where B = 2^N, for a
+	 * p-block d whose top bit is set, by Newton's iteration. */
+	void setReciprocal(const BigUnsigned &d);
+	/* divideWithRemainder by multiplying by the reciprocal of b.  Same
+	 * contract, minus the aliasing and zero checks. */
+	void divideNewton(const BigUnsigned &b, BigUnsigned &q);
+	/* Knuth's Algorithm D, leaving the remainder in *this and storing
+	 * the len - b.len + 1 quotient blocks in q, or dropping them if q is
+	 * NULL.  Requires len >= b.len > 0 and b separate from *this. */
+	void divideKnuth(const BigUnsigned &b, Blk *q);
+	/* *this %= b without building the quotient, except in the Newton
+	 * division, which needs it to find the remainder.  b == 0 leaves
+	 * *this alone, as in divideWithRemainder. */
+	void reduceModulo(const BigUnsigned &b);
+public:
+
 	// See BigInteger.cc.
 	template <class X>
 	friend X convertBigUnsignedToPrimitiveAccess(const BigUnsigned &a);
+
+	// Reduction engines work directly on the block arrays.
+	friend class MontgomeryContext;
+	friend class BarrettContext;
+	template <unsigned int Bits>
+	friend class FixedMontgomeryContext;
+
+	// Power-of-two bases are converted straight from the blocks.
+	friend class BigUnsignedInABase;
+	friend class MultiBufferMontgomery;
 };
 
 /* Implementing the return-by-value and assignment operators in terms of the
@@ -445,9 +972,8 @@ inline BigUnsigned BigUnsigned::operator /(const BigUnsigned &x) const {
 }
 inline BigUnsigned BigUnsigned::operator %(const BigUnsigned &x) const {
 	if (x.isZero()) throw "BigUnsigned::operator %: division by zero";
-	BigUnsigned q, r;
-	r = *this;
-	r.divideWithRemainder(x, q);
+	BigUnsigned r(*this);
+	r.reduceModulo(x);
 	return r;
 }
 inline BigUnsigned BigUnsigned::operator &(const BigUnsigned &x) const {
@@ -492,13 +1018,11 @@ inline void BigUnsigned::operator /=(const BigUnsigned &x) {
 	BigUnsigned q;
 	divideWithRemainder(x, q);
 	// *this contains the remainder, but we overwrite it with the quotient.
-	*this = q;
+	*this = std::move(q);
 }
 inline void BigUnsigned::operator %=(const BigUnsigned &x) {
 	if (x.isZero()) throw "BigUnsigned::operator %=: division by zero";
-	BigUnsigned q;
-	// Mods *this by x.  Don't care about quotient left in q.
-	divideWithRemainder(x, q);
+	reduceModulo(x);
 }
 inline void BigUnsigned::operator &=(const BigUnsigned &x) {
 	bitAnd(*this, x);
@@ -534,9 +1058,7 @@ void BigUnsigned::initFromPrimitive(X x) {
 	if (x == 0)
 		; // NumberlikeArray already initialized us to zero.
 	else {
-		// Create a single block.  blk is NULL; no need to delete it.
-		cap = 1;
-		blk = new Blk[1];
+		// A single block always fits in the inline storage.
 		len = 1;
 		blk[0] = Blk(x);
 	}
@@ -633,6 +1155,12 @@ public:
 	// Assignment operator
 	void operator=(const BigInteger &x);
 
+	// Move constructor and move assignment; x is left as zero.
+	BigInteger(BigInteger &&x) : sign(x.sign), mag(std::move(x.mag)) {
+		x.sign = zero;
+	}
+	void operator=(BigInteger &&x);
+
 	// Constructor that copies from a given array of blocks with a sign.
 	BigInteger(const Blk *b, Index blen, Sign s);
 
@@ -649,6 +1177,11 @@ public:
 		sign = mag.isZero() ? zero : positive;
 	}
 
+	// Same, taking over the blocks of a BigUnsigned that is going away
+	BigInteger(BigUnsigned &&x) : mag(std::move(x)) {
+		sign = mag.isZero() ? zero : positive;
+	}
+
 	// Constructors from primitive integer types
 	BigInteger(unsigned long  x);
 	BigInteger(         long  x);
@@ -675,8 +1208,10 @@ public:
 	// ACCESSORS
 	Sign getSign() const { return sign; }
 	/* The client can't do any harm by holding a read-only reference to the
-	 * magnitude. */
-	const BigUnsigned &getMagnitude() const { return mag; }
+	 * magnitude.  A temporary hands its magnitude over instead, so
+	 * `(a % b).getMagnitude()' doesn't copy. */
+	const BigUnsigned &getMagnitude() const & { return mag; }
+	BigUnsigned getMagnitude() && { return std::move(mag); }
 
 	// Some accessors that go through to the magnitude
 	Index getLength() const { return mag.getLength(); }
@@ -834,6 +1369,721 @@ BigUnsigned modexp(const BigInteger &base, const BigUnsigned &exponent,
 
 #endif
 
+#ifndef MONTGOMERYCONTEXT_H
+#define MONTGOMERYCONTEXT_H
+
+/* A MontgomeryContext lets us multiply modulo a fixed odd modulus n without
+ * ever dividing by n.  Let k be the length of n in blocks and R = 2^(N*k).
+ * A value a is kept in ``Montgomery form'' as aR mod n; the product of two
+ * such values is reduced with REDC, which needs only block multiplications
+ * by n' = -n^(-1) mod 2^N and a final conditional subtraction.
+ *
+ * Building the context costs one division (for R^2 mod n), so build one per
+ * modulus and reuse it.  multiply and square take and return Montgomery
+ * form; toMontgomery and fromMontgomery convert. */
+class MontgomeryContext {
+
+public:
+	typedef BigUnsigned::Blk Blk;
+	typedef BigUnsigned::Index Index;
+
+protected:
+	BigUnsigned n;   // The modulus
+	BigUnsigned rr;  // R^2 mod n
+	BigUnsigned one; // R mod n, which is 1 in Montgomery form
+	Index k;         // Length of n in blocks
+	Blk nInv;        // -n^(-1) mod 2^N
+
+	/* REDC on the 2k + 1 blocks of t, which must hold a value less than
+	 * nR.  Leaves t R^(-1) mod n in the low k blocks. */
+	void reduceBlocks(Blk *t) const;
+
+public:
+	// Constructs an empty context, which must be assigned before use.
+	MontgomeryContext() : k(0), nInv(0) {}
+	// Builds the context for the given odd modulus.
+	explicit MontgomeryContext(const BigUnsigned &modulus);
+
+	// ACCESSORS
+	const BigUnsigned &getModulus() const { return n; }
+	bool isEmpty() const { return k == 0; }
+	// The number 1 in Montgomery form
+	const BigUnsigned &getOne() const { return one; }
+
+	/* r = aR mod n and r = a R^(-1) mod n, respectively.  toMontgomery
+	 * accepts any a; fromMontgomery needs a < nR. */
+	void toMontgomery(BigUnsigned &r, const BigUnsigned &a) const;
+	void fromMontgomery(BigUnsigned &r, const BigUnsigned &a) const;
+
+	/* r = a b R^(-1) mod n and r = a^2 R^(-1) mod n.  The operands must be
+	 * less than n.  Aliased calls work but cost a temporary; keep a spare
+	 * BigUnsigned and swap with it in loops. */
+	void multiply(BigUnsigned &r, const BigUnsigned &a, const BigUnsigned &b) const;
+	void square(BigUnsigned &r, const BigUnsigned &a) const;
+	/* Once k reaches the Karatsuba threshold, the product needs scratch
+	 * blocks.  These take them from scratch, which grows as needed and is
+	 * meant to be kept across a loop of calls; the ones above make a
+	 * scratch of their own each time. */
+	void multiply(BigUnsigned &r, const BigUnsigned &a, const BigUnsigned &b,
+			BigUnsigned &scratch) const;
+	void square(BigUnsigned &r, const BigUnsigned &a,
+			BigUnsigned &scratch) const;
+
+	// REDC in place: t becomes t R^(-1) mod n.  Needs t < nR.
+	void reduce(BigUnsigned &t) const;
+
+	// The fixed-width contexts copy the precomputed values.
+	template <unsigned int Bits>
+	friend class FixedMontgomeryContext;
+};
+
+#endif
+
+#ifndef EXPONENTRECODING_H
+#define EXPONENTRECODING_H
+
+#include <vector>
+
+/* An ExponentRecoding is an exponent cut into windows for left-to-right
+ * sliding-window exponentiation.  Each window says how many times to
+ * square and then which odd power of the base, below 2^windowBits, to
+ * multiply by.  That replaces one multiplication per 1-bit with roughly
+ * one per window, at the cost of a table of 2^(windowBits - 1) odd powers.
+ *
+ * Recoding costs a pass over the exponent's bits, so an exponent that is
+ * used many times (like a private key's) should be recoded once and the
+ * recoding kept alongside it. */
+class ExponentRecoding {
+
+public:
+	typedef BigUnsigned::Index Index;
+
+	struct Window {
+		// Squarings to do before the multiplication
+		Index squarings;
+		// The odd power to multiply by, or 0 for trailing squarings only
+		unsigned int digit;
+	};
+
+protected:
+	std::vector<Window> windows;
+	unsigned int windowBits;
+
+public:
+	// The widest window windowBitsFor picks
+	enum { maxWindowBits = 6 };
+
+	// Recodes zero.
+	ExponentRecoding() : windowBits(1) {}
+	// Recodes the given exponent with a width picked by windowBitsFor.
+	explicit ExponentRecoding(const BigUnsigned &exponent);
+
+	/* A good width for an exponent of the given length: the table costs
+	 * 2^(w-1) multiplications up front and saves about bitLength / (w + 1)
+	 * of them over plain square-and-multiply. */
+	static unsigned int windowBitsFor(Index bitLength);
+
+	// ACCESSORS
+	unsigned int getWindowBits() const { return windowBits; }
+	Index getWindowCount() const { return Index(windows.size()); }
+	const Window &getWindow(Index i) const { return windows[i]; }
+	// The first window's digit is the starting power; its squarings are 0.
+	bool isZero() const { return windows.empty(); }
+	/* Whether the last step multiplies by the base itself, as it does for
+	 * every odd exponent from 3 up to 2^23 (like 3 and 65537).  A Montgomery
+	 * exponentiation can then multiply by the base out of Montgomery form
+	 * instead, which takes the result out of it for free. */
+	bool endsWithBase() const {
+		return windows.size() > 1 && windows.back().digit == 1;
+	}
+};
+
+/* Returns (base ^ exponent) % modulus, where context was built for modulus.
+ * The whole exponentiation stays in Montgomery form and uses a sliding
+ * window. */
+BigUnsigned modexp(const BigInteger &base, const ExponentRecoding &exponent,
+		const MontgomeryContext &context);
+// Same, recoding the exponent on the fly.
+BigUnsigned modexp(const BigInteger &base, const BigUnsigned &exponent,
+		const MontgomeryContext &context);
+
+#endif
+
+#ifndef FIXEDBIGUNSIGNED_H
+#define FIXEDBIGUNSIGNED_H
+
+/* A FixedBigUnsigned<Bits> is a nonnegative integer below 2^Bits kept in a
+ * fixed array of blocks.  It never touches the heap and has no length to
+ * track, so the arithmetic on it runs over loops whose bounds are known at
+ * compile time.  Bits must be a multiple of the block size.
+ *
+ * It has only what modular exponentiation needs: use FixedMontgomeryContext
+ * for the arithmetic and convert to and from BigUnsigned for everything
+ * else. */
+template <unsigned int Bits>
+class FixedBigUnsigned {
+
+public:
+	typedef BigUnsigned::Blk Blk;
+	typedef BigUnsigned::Index Index;
+	// The number of blocks, including any leading zeros
+	enum { numBlocks = Bits / (8 * sizeof(Blk)) };
+
+protected:
+	Blk blk[numBlocks];
+
+public:
+	// Constructs zero.
+	FixedBigUnsigned() {
+		for (Index i = 0; i < numBlocks; i++)
+			blk[i] = 0;
+	}
+	// Copies x, which must be below 2^Bits.
+	explicit FixedBigUnsigned(const BigUnsigned &x);
+
+	// LINK TO BIGUNSIGNED
+	operator BigUnsigned() const { return BigUnsigned(blk, numBlocks); }
+
+	// ACCESSORS
+	Blk getBlock(Index i) const { return blk[i]; }
+
+	template <unsigned int B>
+	friend class FixedMontgomeryContext;
+};
+
+template <unsigned int Bits>
+FixedBigUnsigned<Bits>::FixedBigUnsigned(const BigUnsigned &x) {
+	Index i, xLen = x.getLength();
+	if (xLen > numBlocks)
+		throw "FixedBigUnsigned: Value is too long";
+	for (i = 0; i < xLen; i++)
+		blk[i] = x.getBlock(i);
+	for (; i < numBlocks; i++)
+		blk[i] = 0;
+}
+
+/* Asks the compiler to unroll the loop that follows.  The block loops of a
+ * FixedMontgomeryContext have constant bounds, and unrolling the innermost
+ * ones takes most of the loop overhead out of each multiply-add.  Unrolling
+ * them completely is slower at 2048 bits and up: the code outgrows the
+ * instruction cache. */
+#if defined(__clang__)
+#define FIXEDBIGUNSIGNED_UNROLL _Pragma("unroll 8")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define FIXEDBIGUNSIGNED_UNROLL _Pragma("GCC unroll 8")
+#else
+#define FIXEDBIGUNSIGNED_UNROLL
+#endif
+
+/* A FixedMontgomeryContext<Bits> is a MontgomeryContext for a modulus that
+ * is exactly FixedBigUnsigned<Bits>::numBlocks blocks long, working on
+ * FixedBigUnsigneds.  Products are built and reduced in arrays on the
+ * stack.  Below the Karatsuba threshold, multiply interleaves the two
+ * (``CIOS''), so the working value never grows past k + 2 blocks; at or
+ * above it, the full product comes from the BigUnsigned kernels, with their
+ * scratch space on the stack too.
+ *
+ * It takes its precomputed values from a MontgomeryContext for the same
+ * modulus, so building one is just a copy. */
+template <unsigned int Bits>
+class FixedMontgomeryContext {
+
+public:
+	typedef BigUnsigned::Blk Blk;
+	typedef BigUnsigned::Index Index;
+	typedef FixedBigUnsigned<Bits> Value;
+	enum { k = Value::numBlocks };
+	/* Room for the Karatsuba scratch space of k-block operands, which
+	 * comes to about 4k blocks, or the Toom-3 scratch space if the
+	 * threshold has been lowered that far, which stays under 7k. */
+	enum { scratchSize = 7 * k + 64 };
+
+protected:
+	Value n;   // The modulus
+	Value rr;  // R^2 mod n
+	Value one; // R mod n, which is 1 in Montgomery form
+	Blk nInv;  // -n^(-1) mod 2^N
+	// Whether to build products with the Karatsuba kernels
+	bool useKaratsuba;
+
+	/* Stores u mod n in r, where u is the k blocks at u plus top * R and
+	 * is less than 2n. */
+	void finish(Value &r, const Blk *u, Blk top) const;
+	// REDC on the 2k blocks of t, storing the result in r.
+	void reduceBlocks(Value &r, Blk *t) const;
+
+public:
+	// Copies the given context, whose modulus must be k blocks long.
+	explicit FixedMontgomeryContext(const MontgomeryContext &context);
+
+	// ACCESSORS
+	BigUnsigned getModulus() const { return n; }
+	const Value &getOne() const { return one; }
+
+	/* r = aR mod n and r = a R^(-1) mod n, respectively.  toMontgomery
+	 * accepts any a below 2^Bits; fromMontgomery needs a < n. */
+	void toMontgomery(Value &r, const Value &a) const { multiply(r, a, rr); }
+	void fromMontgomery(Value &r, const Value &a) const;
+
+	/* r = a b R^(-1) mod n and r = a^2 R^(-1) mod n.  b (for multiply) and
+	 * a (for square) must be less than n.  r may alias an operand. */
+	void multiply(Value &r, const Value &a, const Value &b) const;
+	void square(Value &r, const Value &a) const;
+};
+
+template <unsigned int Bits>
+FixedMontgomeryContext<Bits>::FixedMontgomeryContext(
+		const MontgomeryContext &context) : nInv(context.nInv) {
+	if (context.k != Index(k))
+		throw "FixedMontgomeryContext: The modulus has the wrong length";
+	n = Value(context.n);
+	rr = Value(context.rr);
+	one = Value(context.one);
+	useKaratsuba = Index(k) >= BigUnsigned::effectiveKaratsubaThreshold()
+		&& BigUnsigned::karatsubaScratchSize(k) <= Index(scratchSize)
+		&& BigUnsigned::squareScratchSize(k) <= Index(scratchSize);
+}
+
+template <unsigned int Bits>
+void FixedMontgomeryContext<Bits>::finish(Value &r, const Blk *u,
+		Blk top) const {
+	Index i;
+	if (top != 0 || BigUnsigned::compareBlocks(u, n.blk, k) != BigUnsigned::less) {
+		// The borrow out of the top cancels top.
+		Blk borrow = 0;
+		FIXEDBIGUNSIGNED_UNROLL
+		for (i = 0; i < Index(k); i++)
+			r.blk[i] = BigUnsigned::subBorrowBlk(u[i], n.blk[i], borrow);
+	} else
+		for (i = 0; i < Index(k); i++)
+			r.blk[i] = u[i];
+}
+
+template <unsigned int Bits>
+void FixedMontgomeryContext<Bits>::fromMontgomery(Value &r,
+		const Value &a) const {
+	// REDC(a) is the Montgomery product of a and plain 1.
+	Value unit;
+	unit.blk[0] = 1;
+	multiply(r, a, unit);
+}
+
+template <unsigned int Bits>
+void FixedMontgomeryContext<Bits>::multiply(Value &r, const Value &a,
+		const Value &b) const {
+	if (useKaratsuba) {
+		Blk t[2 * k], scratch[scratchSize];
+		BigUnsigned::karatsubaBlocks(t, a.blk, b.blk, k, scratch);
+		reduceBlocks(r, t);
+		return;
+	}
+	Blk t[k + 1];
+	Blk c1, c2, hi, lo, m;
+	Index i, j;
+	for (j = 0; j <= Index(k); j++)
+		t[j] = 0;
+	/* For each block of b, add a * b[i] to t, plus the multiple of n that
+	 * zeroes t's low block, and drop that block.  Both products go through
+	 * t in one pass, each with its own carry.  t stays below 2n. */
+	for (i = 0; i < Index(k); i++) {
+		lo = BigUnsigned::mulBlk(a.blk[0], b.blk[i], hi);
+		lo += t[0];
+		c1 = hi + (lo < t[0]);
+		m = lo * nInv;
+		// lo + m * n[0] is zero in its low block by the choice of m.
+		t[0] = BigUnsigned::mulBlk(m, n.blk[0], hi);
+		c2 = hi + (t[0] + lo < lo);
+		FIXEDBIGUNSIGNED_UNROLL
+		for (j = 1; j < Index(k); j++) {
+			lo = BigUnsigned::mulBlk(a.blk[j], b.blk[i], hi);
+			lo += c1;
+			hi += (lo < c1);
+			lo += t[j];
+			c1 = hi + (lo < t[j]);
+			t[j - 1] = BigUnsigned::mulBlk(m, n.blk[j], hi);
+			t[j - 1] += c2;
+			hi += (t[j - 1] < c2);
+			t[j - 1] += lo;
+			c2 = hi + (t[j - 1] < lo);
+		}
+		// The two carries and t[k] add up to at most two blocks.
+		lo = t[k] + c1;
+		hi = (lo < c1);
+		t[k - 1] = lo + c2;
+		t[k] = hi + (t[k - 1] < c2);
+	}
+	finish(r, t, t[k]);
+}
+
+template <unsigned int Bits>
+void FixedMontgomeryContext<Bits>::reduceBlocks(Value &r, Blk *t) const {
+	Blk carry, m, top = 0;
+	Index i, j;
+	/* Each step adds the multiple of n that zeroes block i of t, keeping
+	 * the bit that spills out of block i + k in top rather than carrying it
+	 * all the way up. */
+	for (i = 0; i < Index(k); i++) {
+		m = t[i] * nInv;
+		carry = 0;
+		FIXEDBIGUNSIGNED_UNROLL
+		for (j = 0; j < Index(k); j++)
+			t[i + j] = BigUnsigned::mulAddBlk(m, n.blk[j], t[i + j], carry);
+		// top comes in as the carry and leaves as the new one.
+		t[i + k] = BigUnsigned::addCarryBlk(t[i + k], carry, top);
+	}
+	finish(r, t + k, top);
+}
+
+template <unsigned int Bits>
+void FixedMontgomeryContext<Bits>::square(Value &r, const Value &a) const {
+	Blk t[2 * k];
+	if (useKaratsuba) {
+		Blk scratch[scratchSize];
+		BigUnsigned::squareBlocks(t, a.blk, k, scratch);
+		reduceBlocks(r, t);
+		return;
+	}
+	Blk carry, hi, lo, top;
+	Index i, j;
+	for (j = 0; j < 2 * Index(k); j++)
+		t[j] = 0;
+	// Each product a[i] * a[j] with i < j once...
+	for (i = 0; i + 1 < Index(k); i++) {
+		carry = 0;
+		for (j = i + 1; j < Index(k); j++)
+			t[i + j] = BigUnsigned::mulAddBlk(a.blk[i], a.blk[j], t[i + j],
+					carry);
+		t[i + k] = carry;
+	}
+	// ...doubled...
+	top = 0;
+	for (j = 0; j < 2 * Index(k); j++) {
+		lo = t[j];
+		t[j] = (lo << 1) | top;
+		top = lo >> (8 * sizeof(Blk) - 1);
+	}
+	// ...plus the squares on the diagonal.
+	carry = 0;
+	for (i = 0; i < Index(k); i++) {
+		lo = BigUnsigned::mulBlk(a.blk[i], a.blk[i], hi);
+		t[2 * i] = BigUnsigned::addCarryBlk(t[2 * i], lo, carry);
+		t[2 * i + 1] = BigUnsigned::addCarryBlk(t[2 * i + 1], hi, carry);
+	}
+	reduceBlocks(r, t);
+}
+
+/* Returns (base ^ exponent) % modulus, where context was built for modulus,
+ * like the MontgomeryContext version but with every intermediate value on
+ * the stack. */
+template <unsigned int Bits>
+BigUnsigned modexp(const BigInteger &base, const ExponentRecoding &exponent,
+		const FixedMontgomeryContext<Bits> &context) {
+	typedef FixedBigUnsigned<Bits> Value;
+	Value ans, temp;
+	if (exponent.isZero()) {
+		context.fromMontgomery(ans, context.getOne());
+		return ans;
+	}
+	// table[j] holds base^(2j + 1) in Montgomery form.
+	Value table[1 << (ExponentRecoding::maxWindowBits - 1)], plain;
+	ExponentRecoding::Index tableSize = 1 << (exponent.getWindowBits() - 1), i, j;
+	ExponentRecoding::Index steps = exponent.getWindowCount();
+	// toMontgomery takes anything that fits; only reduce what doesn't.
+	if (base.getSign() == BigInteger::negative)
+		plain = Value((base % context.getModulus()).getMagnitude());
+	else if (base.getMagnitude().getLength() > BigUnsigned::Index(Value::numBlocks))
+		plain = Value(base.getMagnitude() % context.getModulus());
+	else
+		plain = Value(base.getMagnitude());
+	context.toMontgomery(table[0], plain);
+	// See endsWithBase; multiply needs the base below n.
+	bool fold = exponent.endsWithBase()
+		&& BigUnsigned(plain) < context.getModulus();
+	if (fold)
+		steps--;
+	if (tableSize > 1) {
+		context.square(temp, table[0]);
+		for (j = 1; j < tableSize; j++)
+			context.multiply(table[j], table[j - 1], temp);
+	}
+	// For each window, most to least significant...
+	ans = table[exponent.getWindow(0).digit >> 1];
+	for (i = 1; i < steps; i++) {
+		const ExponentRecoding::Window &w = exponent.getWindow(i);
+		// Square...
+		for (j = 0; j < w.squarings; j++)
+			context.square(ans, ans);
+		// ...and multiply by the window's power.
+		if (w.digit != 0)
+			context.multiply(ans, ans, table[w.digit >> 1]);
+	}
+	if (fold) {
+		for (j = 0; j < exponent.getWindow(steps).squarings; j++)
+			context.square(ans, ans);
+		context.multiply(ans, ans, plain);
+	} else
+		context.fromMontgomery(ans, ans);
+	return ans;
+}
+
+/* Builds a FixedMontgomeryContext<Bits> from context and exponentiates with
+ * it.  All the instantiations have the same signature as the
+ * MontgomeryContext modexp, so a caller that learns the modulus size at run
+ * time can pick one through a function pointer. */
+template <unsigned int Bits>
+BigUnsigned modexpFixed(const BigInteger &base,
+		const ExponentRecoding &exponent, const MontgomeryContext &context) {
+	return modexp(base, exponent, FixedMontgomeryContext<Bits>(context));
+}
+
+#endif
+
+#ifndef MULTIBUFFERMONTGOMERY_H
+#define MULTIBUFFERMONTGOMERY_H
+
+#include <vector>
+
+// The vector engines need GCC-style target attributes and x86-64.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MULTIBUFFERMONTGOMERY_X86
+#include <immintrin.h>
+#endif
+
+/* A MultiBufferMontgomery runs one exponentiation modulo a fixed odd n on
+ * several bases at once, one per SIMD lane: 8 with AVX-512, 4 with AVX2,
+ * picked when the engine is built.  Elsewhere it runs the same code one
+ * lane at a time, which is slower than modexp; check getLanes before
+ * choosing it.
+ *
+ * Numbers are cut into d digits of digitBits bits, each in a 64-bit lane,
+ * and digit j of every lane is stored together (structure of arrays), so
+ * one vector multiply does the same digit product for all the bases.  The
+ * digit products are 2 * digitBits bits, so a lane can add up the products
+ * of carryInterval rows of a multiplication before it has to carry; that
+ * takes the carry chains, which vectors do badly, out of the inner loop.
+ *
+ * With R = 2^(digitBits * d) > 4n, Montgomery multiplication of values
+ * below 2n gives a value below 2n, so the lanes never need the conditional
+ * subtraction that would make them diverge; only the final results are
+ * brought below n. */
+class MultiBufferMontgomery {
+
+public:
+	typedef BigUnsigned::Index Index;
+	typedef unsigned long long Digit;
+	enum {
+		digitBits = 29,
+		// Rows between carries: 16 rows add less than 2^63 to a digit.
+		carryInterval = 16,
+		maxLanes = 8
+	};
+
+protected:
+	BigUnsigned n;          // The modulus
+	Index d;                // Digits per number
+	std::vector<Digit> nd;  // The digits of n
+	std::vector<Digit> rr;  // The digits of R^2 mod n
+	Digit nInv;             // -n^(-1) mod 2^digitBits
+	unsigned int lanes;
+
+	/* r = a b R^(-1) mod 2n on all the lanes, where a, b and r hold d
+	 * digits of lanes numbers each and t is scratch space for d digits.
+	 * r may be a or b. */
+	typedef void (*MulFunction)(Digit *r, const Digit *a, const Digit *b,
+			const Digit *n, Digit nInv, Index d, Digit *t);
+	MulFunction mul;
+
+	// The engines: Ops says how to do each step on a vector of lanes.
+	template <class Ops>
+	static void multiplyLanes(Digit *r, const Digit *a, const Digit *b,
+			const Digit *n, Digit nInv, Index d, Digit *t);
+	template <class Ops>
+	static void carryLanes(Digit *t, Index d);
+	struct ScalarOps;
+	static void multiplyScalar(Digit *r, const Digit *a, const Digit *b,
+			const Digit *n, Digit nInv, Index d, Digit *t);
+#ifdef MULTIBUFFERMONTGOMERY_X86
+	struct AVX2Ops;
+	struct AVX512Ops;
+	static void multiplyAVX2(Digit *r, const Digit *a, const Digit *b,
+			const Digit *n, Digit nInv, Index d, Digit *t);
+	static void multiplyAVX512(Digit *r, const Digit *a, const Digit *b,
+			const Digit *n, Digit nInv, Index d, Digit *t);
+#endif
+
+	/* Moves a number into and out of d digits, stride apart, starting at
+	 * x; with x at lane l of a vector and stride the number of lanes, that
+	 * is lane l.  toDigits takes a < 2^(digitBits * d). */
+	static void toDigits(Digit *x, Index stride, Index d, const BigUnsigned &a);
+	static BigUnsigned fromDigits(const Digit *x, Index stride, Index d);
+
+public:
+	// Constructs an empty engine, which must be assigned before use.
+	MultiBufferMontgomery() : d(0), nInv(0), lanes(1), mul(0) {}
+	/* Builds the engine for the given odd modulus, using at most
+	 * laneLimit lanes (1, 4 or 8) of what the processor has. */
+	explicit MultiBufferMontgomery(const BigUnsigned &modulus,
+			unsigned int laneLimit = maxLanes);
+
+	// ACCESSORS
+	const BigUnsigned &getModulus() const { return n; }
+	bool isEmpty() const { return d == 0; }
+	// How many bases one pass works on
+	unsigned int getLanes() const { return lanes; }
+
+	/* results[i] = (bases[i] ^ exponent) % n for i < count, getLanes()
+	 * bases at a time.  results may be bases. */
+	void modexp(BigUnsigned *results, const BigUnsigned *bases, Index count,
+			const ExponentRecoding &exponent) const;
+};
+
+/* The signature shared by the MontgomeryContext modexp and every
+ * modexpFixed<Bits>, so a caller can hold whichever suits its modulus. */
+typedef BigUnsigned (*ModexpFunction)(const BigInteger &base,
+		const ExponentRecoding &exponent, const MontgomeryContext &context);
+
+/* results[i] = (bases[i] ^ exponent) % n for i < count, where multi and
+ * context were both built for n.  results may be bases.  The recoding and
+ * the contexts are shared by the whole batch.  Full passes of multi's
+ * lanes go through multi; so does a last, partial pass if it fills more
+ * than half the lanes, and otherwise its bases go one at a time through
+ * single. */
+void modexpBatch(BigUnsigned *results, const BigUnsigned *bases,
+		BigUnsigned::Index count, const ExponentRecoding &exponent,
+		const MultiBufferMontgomery &multi, const MontgomeryContext &context,
+		ModexpFunction single = &modexp);
+// Same, building everything for the given modulus, which may be even.
+void modexpBatch(BigUnsigned *results, const BigUnsigned *bases,
+		BigUnsigned::Index count, const BigUnsigned &exponent,
+		const BigUnsigned &modulus);
+
+/* One row of the multiplication adds a_i b + m n to t, with m picked to
+ * make the low digit divisible by 2^digitBits, and shifts t down a digit.
+ * The digits of t are left uncarried for up to carryInterval rows.
+ *
+ * The Ops take and give vectors by reference: this code is compiled
+ * without the vector instruction sets, and passing vectors by value
+ * between it and the Ops would not agree on where they go.  Once flatten
+ * has inlined everything, the references cost nothing. */
+template <class Ops>
+void MultiBufferMontgomery::multiplyLanes(Digit *r, const Digit *a,
+		const Digit *b, const Digit *n, Digit nInv, Index d, Digit *t) {
+	typedef typename Ops::V V;
+	const Index L = Ops::lanes;
+	V mask, inv, zero, ai, t0, m, carry, x, y;
+	Ops::set1(mask, (Digit(1) << digitBits) - 1);
+	Ops::set1(inv, nInv);
+	Ops::set1(zero, 0);
+	Index i, j;
+	for (j = 0; j < d; j++)
+		Ops::store(t + j * L, zero);
+	for (i = 0; i < d; i++) {
+		Ops::load(ai, a + i * L);
+		// t0 = t[0] + a_i b[0] and m = t0 n' mod 2^digitBits
+		Ops::load(x, b);
+		Ops::mul(x, ai, x);
+		Ops::load(t0, t);
+		Ops::add(t0, t0, x);
+		Ops::bitAnd(m, t0, mask);
+		Ops::mul(m, m, inv);
+		Ops::bitAnd(m, m, mask);
+		Ops::set1(x, n[0]);
+		Ops::mul(x, m, x);
+		Ops::add(t0, t0, x);
+		// The low digit is now a multiple of 2^digitBits; keep the carry.
+		Ops::shiftDigit(carry, t0);
+		for (j = 1; j < d; j++) {
+			Ops::load(x, b + j * L);
+			Ops::mul(x, ai, x);
+			Ops::set1(y, n[j]);
+			Ops::mul(y, m, y);
+			Ops::add(x, x, y);
+			Ops::load(y, t + j * L);
+			Ops::add(x, x, y);
+			Ops::store(t + (j - 1) * L, x);
+		}
+		Ops::store(t + (d - 1) * L, zero);
+		Ops::load(x, t);
+		Ops::add(x, x, carry);
+		Ops::store(t, x);
+		if (i % carryInterval == carryInterval - 1)
+			carryLanes<Ops>(t, d);
+	}
+	carryLanes<Ops>(t, d);
+	for (j = 0; j < d; j++) {
+		Ops::load(x, t + j * L);
+		Ops::store(r + j * L, x);
+	}
+}
+
+// Carries each digit of t into the next, leaving the top one whole.
+template <class Ops>
+void MultiBufferMontgomery::carryLanes(Digit *t, Index d) {
+	typedef typename Ops::V V;
+	const Index L = Ops::lanes;
+	V mask, carry, x;
+	Ops::set1(mask, (Digit(1) << digitBits) - 1);
+	Ops::set1(carry, 0);
+	for (Index j = 0; j + 1 < d; j++) {
+		Ops::load(x, t + j * L);
+		Ops::add(x, x, carry);
+		Ops::shiftDigit(carry, x);
+		Ops::bitAnd(x, x, mask);
+		Ops::store(t + j * L, x);
+	}
+	Ops::load(x, t + (d - 1) * L);
+	Ops::add(x, x, carry);
+	Ops::store(t + (d - 1) * L, x);
+}
+
+#endif
+
+#ifndef BARRETTCONTEXT_H
+#define BARRETTCONTEXT_H
+
+/* A BarrettContext reduces modulo a fixed modulus n using multiplications
+ * instead of division.  With k the length of n in blocks and b = 2^N, it
+ * precomputes mu = floor(b^(2k) / n) once; reducing any x < b^(2k) then
+ * takes two multiplications and at most two subtractions of n.  (See
+ * Algorithm 14.42 in the Handbook of Applied Cryptography.)
+ *
+ * Unlike MontgomeryContext, it works on ordinary values and the modulus
+ * may be even, so it suits one-off reductions where converting in and out
+ * of Montgomery form would not pay off. */
+class BarrettContext {
+
+public:
+	typedef BigUnsigned::Blk Blk;
+	typedef BigUnsigned::Index Index;
+
+protected:
+	BigUnsigned n;  // The modulus
+	BigUnsigned mu; // floor(b^(2k) / n)
+	Index k;        // Length of n in blocks
+
+public:
+	// Constructs an empty context, which must be assigned before use.
+	BarrettContext() : k(0) {}
+	// Builds the context for the given nonzero modulus.
+	explicit BarrettContext(const BigUnsigned &modulus);
+
+	// ACCESSORS
+	const BigUnsigned &getModulus() const { return n; }
+	bool isEmpty() const { return k == 0; }
+
+	/* x becomes x mod n.  Values of up to 2k blocks (such as the product
+	 * of two reduced values) take the fast path; longer ones fall back to
+	 * divideWithRemainder. */
+	void reduce(BigUnsigned &x) const;
+
+	/* r = a b mod n and r = a^2 mod n, for a and b less than n.  Aliased
+	 * calls are fine. */
+	void multiply(BigUnsigned &r, const BigUnsigned &a, const BigUnsigned &b) const;
+	void square(BigUnsigned &r, const BigUnsigned &a) const;
+};
+
+#endif
+
 #ifndef BIGUNSIGNEDINABASE_H
 #define BIGUNSIGNEDINABASE_H
 
@@ -876,7 +2126,7 @@ protected:
 	Base base;
 
 	// Creates a BigUnsignedInABase with a capacity; for internal use.
-	BigUnsignedInABase(int, Index c) : NumberlikeArray<Digit>(0, c) {}
+	BigUnsignedInABase(int, Index c) : NumberlikeArray<Digit>(c) {}
 
 	// Decreases len to eliminate any leading zero digits.
 	void zapLeadingZeros() { 
@@ -897,6 +2147,14 @@ public:
 		base = x.base;
 	}
 
+	// Move constructor and move assignment; x is left as zero.
+	BigUnsignedInABase(BigUnsignedInABase &&x)
+			: NumberlikeArray<Digit>(std::move(x)), base(x.base) {}
+	void operator =(BigUnsignedInABase &&x) {
+		NumberlikeArray<Digit>::operator =(std::move(x));
+		base = x.base;
+	}
+
 	// Constructor that copies from a given array of digits.
 	BigUnsignedInABase(const Digit *d, Index l, Base base);
 
@@ -1028,6 +2286,137 @@ BigInteger dataToBigInteger(const T* data, BigInteger::Index length, BigInteger:
 #endif
 
 
+// BLOCKARENA
+
+thread_local BlockArena *BlockArena::current = NULL;
+
+BlockArena::BlockArena(std::size_t chunkBytes)
+	: chunkBytes(chunkBytes), first(NULL), chunk(NULL), top(NULL), end(NULL) {}
+
+BlockArena::~BlockArena() {
+	while (first != NULL) {
+		Chunk *next = first->next;
+		::operator delete(first);
+		first = next;
+	}
+}
+
+void BlockArena::useChunk(Chunk *c) {
+	chunk = c;
+	top = chunkStart(c);
+	end = top + c->bytes;
+}
+
+void *BlockArena::allocate(std::size_t bytes) {
+	bytes = roundUp(bytes);
+	if (std::size_t(end - top) < bytes) {
+		// Move on to the next chunk if it is big enough, or put a new one
+		// in front of it.  Chunks after the current one are all unused.
+		Chunk *next = (chunk == NULL) ? first : chunk->next;
+		if (next == NULL || next->bytes < bytes) {
+			std::size_t size = (bytes > chunkBytes) ? bytes : roundUp(chunkBytes);
+			Chunk *c = static_cast<Chunk *>(
+				::operator new(roundUp(sizeof(Chunk)) + size));
+			c->bytes = size;
+			c->next = next;
+			if (chunk == NULL)
+				first = c;
+			else
+				chunk->next = c;
+			next = c;
+		}
+		useChunk(next);
+	}
+	void *p = top;
+	top += bytes;
+	return p;
+}
+
+void BlockArena::deallocate(void *p, std::size_t bytes) {
+	if (static_cast<char *>(p) + roundUp(bytes) == top)
+		top = static_cast<char *>(p);
+}
+
+void BlockArena::reset() {
+	if (first != NULL)
+		useChunk(first);
+}
+
+// BLOCKPOOLALLOCATOR
+
+thread_local BlockPoolAllocator::FreeLists BlockPoolAllocator::freeLists;
+
+BlockPoolAllocator::FreeLists::FreeLists() {
+	for (unsigned int c = 0; c < numClasses; c++) {
+		heads[c] = NULL;
+		counts[c] = 0;
+	}
+}
+
+BlockPoolAllocator::FreeLists::~FreeLists() {
+	for (unsigned int c = 0; c < numClasses; c++) {
+		while (heads[c] != NULL) {
+			Header *next = *reinterpret_cast<Header **>(heads[c] + 1);
+			::operator delete(heads[c]);
+			heads[c] = next;
+		}
+		/* Static numbers can still be destroyed after this; send what they
+		 * free straight back to the system. */
+		counts[c] = maxCachedPerClass;
+	}
+}
+
+void *BlockPoolAllocator::allocate(std::size_t bytes) {
+	std::size_t total = bytes + sizeof(Header);
+	Header *h;
+	BlockArena *arena = BlockArena::getCurrent();
+	if (arena != NULL) {
+		h = static_cast<Header *>(arena->allocate(total));
+		h->info.sizeClass = arenaTag;
+	} else {
+		unsigned int c = 0;
+		while (c < numClasses && (std::size_t(1) << (c + minClassBits)) < total)
+			c++;
+		if (c == numClasses) {
+			h = static_cast<Header *>(::operator new(total));
+		} else {
+			FreeLists &lists = freeLists;
+			if (lists.heads[c] != NULL) {
+				// The next link is kept in the freed array itself.
+				h = lists.heads[c];
+				lists.heads[c] = *reinterpret_cast<Header **>(h + 1);
+				lists.counts[c]--;
+			} else
+				h = static_cast<Header *>(
+					::operator new(std::size_t(1) << (c + minClassBits)));
+		}
+		h->info.sizeClass = c;
+	}
+	h->info.bytes = total;
+	h->info.arena = arena;
+	return h + 1;
+}
+
+void BlockPoolAllocator::deallocate(void *p) {
+	if (p == NULL)
+		return;
+	Header *h = static_cast<Header *>(p) - 1;
+	std::size_t c = h->info.sizeClass;
+	if (c == arenaTag)
+		h->info.arena->deallocate(h, h->info.bytes);
+	else if (c == largeTag)
+		::operator delete(h);
+	else {
+		FreeLists &lists = freeLists;
+		if (lists.counts[c] < maxCachedPerClass) {
+			*reinterpret_cast<Header **>(h + 1) = lists.heads[c];
+			lists.heads[c] = h;
+			lists.counts[c]++;
+		} else
+			::operator delete(h);
+	}
+}
+
 // Memory management definitions have moved to the bottom of NumberlikeArray.hh.
 
 // The templates used by these constructors and converters are at the bottom of
@@ -1047,6 +2436,70 @@ long           BigUnsigned::toLong         () const { return convertToSignedPrim
 int            BigUnsigned::toInt          () const { return convertToSignedPrimitive<         int  >(); }
 short          BigUnsigned::toShort        () const { return convertToSignedPrimitive<         short>(); }
 
+// CONVERSION TO AND FROM BYTES
+
+namespace {
+	/* Loads and stores a block as big-endian bytes.  On little-endian
+	 * machines with 64-bit blocks, this is a single byte swap. */
+	inline BigUnsigned::Blk loadBlockBE(const unsigned char *p) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (sizeof(BigUnsigned::Blk) == 8) {
+			unsigned long long v;
+			std::memcpy(&v, p, 8);
+			return BigUnsigned::Blk(__builtin_bswap64(v));
+		}
+#endif
+		BigUnsigned::Blk b = 0;
+		for (std::size_t j = 0; j < sizeof(BigUnsigned::Blk); j++)
+			b = (b << 8) | p[j];
+		return b;
+	}
+	inline void storeBlockBE(unsigned char *p, BigUnsigned::Blk b) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		if (sizeof(BigUnsigned::Blk) == 8) {
+			unsigned long long v = __builtin_bswap64((unsigned long long)b);
+			std::memcpy(p, &v, 8);
+			return;
+		}
+#endif
+		for (std::size_t j = sizeof(BigUnsigned::Blk); j > 0; j--) {
+			p[j - 1] = (unsigned char)b;
+			b >>= 8;
+		}
+	}
+}
+
+BigUnsigned BigUnsigned::fromBytesBE(const unsigned char *bytes, std::size_t n) {
+	BigUnsigned x(0, Index((n + sizeof(Blk) - 1) / sizeof(Blk)));
+	// Whole blocks come from the end of the array.
+	Index i = 0;
+	for (; n >= sizeof(Blk); i++, n -= sizeof(Blk))
+		x.blk[i] = loadBlockBE(bytes + n - sizeof(Blk));
+	// The first n bytes make the top block.
+	if (n > 0) {
+		Blk b = 0;
+		for (std::size_t j = 0; j < n; j++)
+			b = (b << 8) | bytes[j];
+		x.blk[i++] = b;
+	}
+	x.len = i;
+	x.zapLeadingZeros();
+	return x;
+}
+
+void BigUnsigned::toBytesBE(unsigned char *bytes, std::size_t n) const {
+	Index i = 0;
+	for (; n >= sizeof(Blk); i++, n -= sizeof(Blk))
+		storeBlockBE(bytes + n - sizeof(Blk), getBlock(i));
+	if (n > 0) {
+		Blk b = getBlock(i);
+		for (std::size_t j = n; j > 0; j--) {
+			bytes[j - 1] = (unsigned char)b;
+			b >>= 8;
+		}
+	}
+}
+
 // BIT/BLOCK ACCESSORS
 
 void BigUnsigned::setBlock(Index i, Blk newBlock) {
@@ -1125,7 +2578,7 @@ BigUnsigned::CmpRes BigUnsigned::compareTo(const BigUnsigned &x) const {
  * inputs is coming from the same variable into which the output is to be
  * stored (an "aliased" call), we risk overwriting the input before we read it.
  * In this case, we first compute the result into a temporary BigUnsigned
- * variable and then copy it into the requested output variable *this.
+ * variable and then move it into the requested output variable *this.
  * Each put-here operation uses the DTRT_ALIASED_UNS macro (Do The Right Thing on
  * aliased calls) to generate code for this check.
  * 
@@ -1143,7 +2596,7 @@ BigUnsigned::CmpRes BigUnsigned::compareTo(const BigUnsigned &x) const {
 	if (cond) { \
 		BigUnsigned tmpThis; \
 		tmpThis.op; \
-		*this = tmpThis; \
+		*this = std::move(tmpThis); \
 		return; \
 	}
 
@@ -1160,9 +2613,7 @@ void BigUnsigned::add(const BigUnsigned &a, const BigUnsigned &b) {
 		return;
 	}
 	// Some variables...
-	// Carries in and out of an addition stage
-	bool carryIn, carryOut;
-	Blk temp;
+	Blk carry;
 	Index i;
 	// a2 points to the longer input, b2 points to the shorter
 	const BigUnsigned *a2, *b2;
@@ -1176,34 +2627,18 @@ void BigUnsigned::add(const BigUnsigned &a, const BigUnsigned &b) {
 	// Set prelimiary length and make room in this BigUnsigned
 	len = a2->len + 1;
 	allocate(len);
-	// For each block index that is present in both inputs...
-	for (i = 0, carryIn = false; i < b2->len; i++) {
-		// Add input blocks
-		temp = a2->blk[i] + b2->blk[i];
-		// If a rollover occurred, the result is less than either input.
-		// This test is used many times in the BigUnsigned code.
-		carryOut = (temp < a2->blk[i]);
-		// If a carry was input, handle it
-		if (carryIn) {
-			temp++;
-			carryOut |= (temp == 0);
-		}
-		blk[i] = temp; // Save the addition result
-		carryIn = carryOut; // Pass the carry along
-	}
+	// Add the block indices present in both inputs as one carry chain.
+	carry = addBlocks(blk, a2->blk, b2->blk, b2->len);
 	// If there is a carry left over, increase blocks until
 	// one does not roll over.
-	for (; i < a2->len && carryIn; i++) {
-		temp = a2->blk[i] + 1;
-		carryIn = (temp == 0);
-		blk[i] = temp;
-	}
+	for (i = b2->len; i < a2->len && carry != 0; i++)
+		blk[i] = addCarryBlk(a2->blk[i], 0, carry);
 	// If the carry was resolved but the larger number
 	// still has blocks, copy them over.
 	for (; i < a2->len; i++)
 		blk[i] = a2->blk[i];
 	// Set the extra block if there's still a carry, decrease length otherwise
-	if (carryIn)
+	if (carry != 0)
 		blk[i] = 1;
 	else
 		len--;
@@ -1220,36 +2655,21 @@ void BigUnsigned::subtract(const BigUnsigned &a, const BigUnsigned &b) {
 		throw "BigUnsigned::subtract: "
 			"Negative result in unsigned calculation";
 	// Some variables...
-	bool borrowIn, borrowOut;
-	Blk temp;
+	Blk borrow;
 	Index i;
 	// Set preliminary length and make room
 	len = a.len;
 	allocate(len);
-	// For each block index that is present in both inputs...
-	for (i = 0, borrowIn = false; i < b.len; i++) {
-		temp = a.blk[i] - b.blk[i];
-		// If a reverse rollover occurred,
-		// the result is greater than the block from a.
-		borrowOut = (temp > a.blk[i]);
-		// Handle an incoming borrow
-		if (borrowIn) {
-			borrowOut |= (temp == 0);
-			temp--;
-		}
-		blk[i] = temp; // Save the subtraction result
-		borrowIn = borrowOut; // Pass the borrow along
-	}
+	// Subtract the block indices present in both inputs as one borrow chain.
+	borrow = subBlocks(blk, a.blk, b.blk, b.len);
 	// If there is a borrow left over, decrease blocks until
 	// one does not reverse rollover.
-	for (; i < a.len && borrowIn; i++) {
-		borrowIn = (a.blk[i] == 0);
-		blk[i] = a.blk[i] - 1;
-	}
+	for (i = b.len; i < a.len && borrow != 0; i++)
+		blk[i] = subBorrowBlk(a.blk[i], 0, borrow);
 	/* If there's still a borrow, the result is negative.
 	 * Throw an exception, but zero out this object so as to leave it in a
 	 * predictable state. */
-	if (borrowIn) {
+	if (borrow != 0) {
 		len = 0;
 		throw "BigUnsigned::subtract: Negative result in unsigned calculation";
 	} else
@@ -1263,9 +2683,8 @@ void BigUnsigned::subtract(const BigUnsigned &a, const BigUnsigned &b) {
 /*
  * About the multiplication and division algorithms:
  *
- * I searched unsucessfully for fast C++ built-in operations like the `b_0'
- * and `c_0' Knuth describes in Section 4.3.1 of ``The Art of Computer
- * Programming'' (replace `place' by `Blk'):
+ * Knuth describes these operations in Section 4.3.1 of ``The Art of
+ * Computer Programming'' (replace `place' by `Blk'):
  *
  *    ``b_0[:] multiplication of a one-place integer by another one-place
  *      integer, giving a two-place answer;
@@ -1274,30 +2693,20 @@ void BigUnsigned::subtract(const BigUnsigned &a, const BigUnsigned &b) {
  *      provided that the quotient is a one-place integer, and yielding
  *      also a one-place remainder.''
  *
- * I also missed his note that ``[b]y adjusting the word size, if
- * necessary, nearly all computers will have these three operations
- * available'', so I gave up on trying to use algorithms similar to his.
- * A future version of the library might include such algorithms; I
- * would welcome contributions from others for this.
- *
- * I eventually decided to use bit-shifting algorithms.  To multiply `a'
- * and `b', we zero out the result.  Then, for each `1' bit in `a', we
- * shift `b' left the appropriate amount and add it to the result.
- * Similarly, to divide `a' by `b', we shift `b' left varying amounts,
- * repeatedly trying to subtract it from `a'.  When we succeed, we note
- * the fact by setting a bit in the quotient.  While these algorithms
- * have the same O(n^2) time complexity as Knuth's, the ``constant factor''
- * is likely to be larger.
- *
- * Because I used these algorithms, which require single-block addition
- * and subtraction rather than single-block multiplication and division,
- * the innermost loops of all four routines are very similar.  Study one
- * of them and all will become clear.
+ * `mulBlk' is `b_0': it uses the compiler's double-width integer type
+ * where there is one (`unsigned __int128' on 64-bit GCC and Clang) and
+ * falls back to four half-block products otherwise.  Multiplication is
+ * built on it and works a block at a time.
+ *
+ * `divBlk' is `c_0': it uses the processor's two-by-one division on x86-64,
+ * the double-width type elsewhere if there is one, and otherwise divides
+ * half blocks at a time.  Division is Knuth's Algorithm D built on it, so
+ * it too works a block at a time.
  */
 
 /*
- * This is a little inline function used by both the multiplication
- * routine and the division routine.
+ * This is a little inline function used by the division routine and the
+ * shifts.
  *
  * `getShiftedBlock' returns the `x'th block of `num << y'.
  * `y' may be anything from 0 to N - 1, and `x' may be anything from
@@ -1325,75 +2734,1070 @@ inline BigUnsigned::Blk getShiftedBlock(const BigUnsigned &num,
 	return part1 | part2;
 }
 
-void BigUnsigned::multiply(const BigUnsigned &a, const BigUnsigned &b) {
-	DTRT_ALIASED_UNS(this == &a || this == &b, multiply(a, b));
-	// If either a or b is zero, set to zero.
-	if (a.len == 0 || b.len == 0) {
+#if defined(__SIZEOF_INT128__)
+// Double-width type used by mulBlk.  __extension__ keeps -pedantic quiet.
+__extension__ typedef unsigned __int128 BigUnsignedDoubleBlk;
+#define BIGUNSIGNED_HAVE_DOUBLE_BLK 1
+#endif
+
+inline BigUnsigned::Blk BigUnsigned::mulBlk(Blk a, Blk b, Blk &hi) {
+#ifdef BIGUNSIGNED_HAVE_DOUBLE_BLK
+	BigUnsignedDoubleBlk p = BigUnsignedDoubleBlk(a) * b;
+	hi = Blk(p >> N);
+	return Blk(p);
+#else
+	// Multiply the half blocks separately and add up the four products.
+	const unsigned int H = N / 2;
+	const Blk lowMask = (Blk(1) << H) - 1;
+	Blk a0 = a & lowMask, a1 = a >> H, b0 = b & lowMask, b1 = b >> H;
+	Blk p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+	// None of these sums can roll over.
+	Blk mid = (p00 >> H) + (p01 & lowMask) + (p10 & lowMask);
+	hi = p11 + (p01 >> H) + (p10 >> H) + (mid >> H);
+	return (mid << H) | (p00 & lowMask);
+#endif
+}
+
+inline BigUnsigned::Blk BigUnsigned::divBlk(Blk hi, Blk lo, Blk d,
+		Blk &rem) {
+#if defined(__GNUC__) && defined(__x86_64__)
+	Blk quot;
+	__asm__("divq %4" : "=a"(quot), "=d"(rem) : "a"(lo), "d"(hi), "rm"(d));
+	return quot;
+#elif defined(BIGUNSIGNED_HAVE_DOUBLE_BLK)
+	BigUnsignedDoubleBlk u = (BigUnsignedDoubleBlk(hi) << N) | lo;
+	Blk quot = Blk(u / d);
+	rem = lo - quot * d;
+	return quot;
+#else
+	/* Divide (hi, lo) by d as a 4-by-2 division in half blocks: two steps
+	 * of Algorithm D, each estimating a half-block quotient digit from d's
+	 * top half and correcting it with the bottom half.  See ``Hacker's
+	 * Delight'', section 9-4. */
+	const unsigned int H = N / 2;
+	const Blk b = Blk(1) << H, lowMask = b - 1;
+	Blk d1 = d >> H, d0 = d & lowMask;
+	Blk l1 = lo >> H, l0 = lo & lowMask;
+	Blk q1 = hi / d1, r = hi - q1 * d1;
+	while (q1 >= b || q1 * d0 > ((r << H) | l1)) {
+		q1--;
+		r += d1;
+		if (r >= b)
+			break;
+	}
+	// The middle two-block remainder; its true value fits in one block.
+	Blk mid = (hi << H) + l1 - q1 * d;
+	Blk q0 = mid / d1;
+	r = mid - q0 * d1;
+	while (q0 >= b || q0 * d0 > ((r << H) | l0)) {
+		q0--;
+		r += d1;
+		if (r >= b)
+			break;
+	}
+	rem = (mid << H) + l0 - q0 * d;
+	return (q1 << H) | q0;
+#endif
+}
+
+inline BigUnsigned::Blk BigUnsigned::addCarryBlk(Blk a, Blk b, Blk &carry) {
+#if defined(BIGUNSIGNED_X86_CARRY)
+	unsigned long long r;
+	carry = _addcarry_u64((unsigned char)carry, a, b, &r);
+	return Blk(r);
+#elif defined(BIGUNSIGNED_HAVE_DOUBLE_BLK)
+	BigUnsignedDoubleBlk s = BigUnsignedDoubleBlk(a) + b + carry;
+	carry = Blk(s >> N);
+	return Blk(s);
+#else
+	Blk s = a + carry;
+	carry = (s < carry);
+	s += b;
+	carry += (s < b);
+	return s;
+#endif
+}
+
+inline BigUnsigned::Blk BigUnsigned::subBorrowBlk(Blk a, Blk b, Blk &borrow) {
+#if defined(BIGUNSIGNED_X86_CARRY)
+	unsigned long long r;
+	borrow = _subborrow_u64((unsigned char)borrow, a, b, &r);
+	return Blk(r);
+#elif defined(BIGUNSIGNED_HAVE_DOUBLE_BLK)
+	BigUnsignedDoubleBlk d = BigUnsignedDoubleBlk(a) - b - borrow;
+	// The high block is all ones exactly when the difference went negative.
+	borrow = Blk(d >> N) & 1;
+	return Blk(d);
+#else
+	Blk d = a - b, r = d - borrow;
+	// At most one of the two steps can wrap around.
+	borrow = (d > a) + (r > d);
+	return r;
+#endif
+}
+
+inline BigUnsigned::Blk BigUnsigned::mulAddBlk(Blk a, Blk b, Blk c,
+		Blk &carry) {
+#ifdef BIGUNSIGNED_HAVE_DOUBLE_BLK
+	// (2^N - 1)^2 + 2 (2^N - 1) = 2^2N - 1, so this can't overflow.
+	BigUnsignedDoubleBlk p = BigUnsignedDoubleBlk(a) * b + c + carry;
+	carry = Blk(p >> N);
+	return Blk(p);
+#else
+	Blk hi, lo = mulBlk(a, b, hi), k = 0;
+	lo = addCarryBlk(lo, c, k);
+	hi += k;
+	k = 0;
+	lo = addCarryBlk(lo, carry, k);
+	carry = hi + k;
+	return lo;
+#endif
+}
+
+inline void BigUnsigned::mulAccBlk(Blk a, Blk b, Blk &c0, Blk &c1, Blk &c2) {
+	Blk hi, lo = mulBlk(a, b, hi), k = 0;
+	c0 = addCarryBlk(c0, lo, k);
+	c1 = addCarryBlk(c1, hi, k);
+	c2 += k;
+}
+
+/*
+ * Product scanning (``Comba'') multiplication: block k of the result is the
+ * sum of a[i] * b[k - i] over all valid i, plus the carry from block k - 1.
+ * Each column is summed into a three-block accumulator and written exactly
+ * once, so the inner loop does one mulBlk and a few additions per product.
+ */
+void BigUnsigned::multiplyBlocksBasecase(Blk *r, const Blk *a, Index na,
+		const Blk *b, Index nb) {
+	Blk c0 = 0, c1 = 0, c2 = 0;
+	Index i, iEnd, k;
+	for (k = 0; k < na + nb - 1; k++) {
+		// a[i] * b[k - i] needs i < na and k - i < nb.
+		i = (k >= nb) ? k - nb + 1 : 0;
+		iEnd = (k < na) ? k : na - 1;
+		for (; i <= iEnd; i++)
+			mulAccBlk(a[i], b[k - i], c0, c1, c2);
+		r[k] = c0;
+		c0 = c1;
+		c1 = c2;
+		c2 = 0;
+	}
+	r[k] = c0;
+}
+
+inline BigUnsigned::Blk BigUnsigned::addBlocks(Blk *r, const Blk *a,
+		const Blk *b, Index n) {
+	Blk carry = 0;
+	for (Index i = 0; i < n; i++)
+		r[i] = addCarryBlk(a[i], b[i], carry);
+	return carry;
+}
+
+inline BigUnsigned::Blk BigUnsigned::subBlocks(Blk *r, const Blk *a,
+		const Blk *b, Index n) {
+	Blk borrow = 0;
+	for (Index i = 0; i < n; i++)
+		r[i] = subBorrowBlk(a[i], b[i], borrow);
+	return borrow;
+}
+
+inline BigUnsigned::Blk BigUnsigned::addBlockToBlocks(Blk *r, Index n, Blk c) {
+	for (Index i = 0; i < n && c != 0; i++) {
+		r[i] += c;
+		c = (r[i] < c);
+	}
+	return c;
+}
+
+inline BigUnsigned::Blk BigUnsigned::subBlockFromBlocks(Blk *r, Index n, Blk c) {
+	for (Index i = 0; i < n && c != 0; i++) {
+		Blk temp = r[i];
+		r[i] = temp - c;
+		c = (r[i] > temp);
+	}
+	return c;
+}
+
+inline BigUnsigned::Blk BigUnsigned::mulAddBlocks(Blk *r, const Blk *a,
+		Index n, Blk m) {
+#ifdef BIGUNSIGNED_X86_CARRY
+#if defined(__ADX__) && defined(__BMI2__)
+	if (n != 0)
+		return mulAddBlocksADX(r, a, n, m);
+#else
+	static const bool adx = haveADX();
+	if (adx && n != 0)
+		return mulAddBlocksADX(r, a, n, m);
+#endif
+#endif
+	Blk carry = 0;
+	for (Index i = 0; i < n; i++)
+		r[i] = mulAddBlk(a[i], m, r[i], carry);
+	return carry;
+}
+
+inline BigUnsigned::Blk BigUnsigned::mulSubBlocks(Blk *r, const Blk *a,
+		Index n, Blk m) {
+	Blk carry = 0, borrow = 0;
+	for (Index i = 0; i < n; i++)
+		r[i] = subBorrowBlk(r[i], mulAddBlk(a[i], m, 0, carry), borrow);
+	// a * m + borrow fits in n + 1 blocks, so this can't roll over.
+	return carry + borrow;
+}
+
+#ifdef BIGUNSIGNED_X86_CARRY
+/*
+ * Each step adds the previous high block and r[i] to the low block of
+ * a[i] * m.  GCC won't keep CF alive across loop iterations when that is
+ * written with intrinsics, so the loop is in assembly: adox carries the
+ * high-block chain in OF while adcx carries the r[i] chain in CF, and
+ * nothing in the loop body touches either flag.  jrcxz tests the count
+ * without clobbering them.
+ */
+inline BigUnsigned::Blk BigUnsigned::mulAddBlocksADX(Blk *r, const Blk *a,
+		Index n, Blk m) {
+	Blk hiPrev, lo, hi, count = n;
+	__asm__ volatile(
+		"xorl %k[hp], %k[hp]\n\t" // also clears CF and OF
+		"1:\n\t"
+		"mulx (%[a]), %[lo], %[hi]\n\t"
+		"adox %[hp], %[lo]\n\t"
+		"adcx (%[r]), %[lo]\n\t"
+		"movq %[lo], (%[r])\n\t"
+		"movq %[hi], %[hp]\n\t"
+		"leaq 8(%[a]), %[a]\n\t"
+		"leaq 8(%[r]), %[r]\n\t"
+		"leaq -1(%[n]), %[n]\n\t"
+		"jrcxz 2f\n\t"
+		"jmp 1b\n"
+		"2:\n\t"
+		// Fold both outstanding carries into the last high block.
+		"movl $0, %k[lo]\n\t"
+		"adox %[lo], %[hp]\n\t"
+		"adcx %[lo], %[hp]\n\t"
+		: [hp] "=&r"(hiPrev), [lo] "=&r"(lo), [hi] "=&r"(hi),
+			[a] "+r"(a), [r] "+r"(r), [n] "+c"(count)
+		: "d"(m)
+		: "cc", "memory");
+	return hiPrev;
+}
+
+bool BigUnsigned::haveADX() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+}
+#endif
+
+inline BigUnsigned::CmpRes BigUnsigned::compareBlocks(const Blk *a,
+		const Blk *b, Index n) {
+	while (n > 0) {
+		n--;
+		if (a[n] != b[n])
+			return (a[n] > b[n]) ? greater : less;
+	}
+	return equal;
+}
+
+bool BigUnsigned::absDiffBlocks(Blk *r, const Blk *x, Index nx,
+		const Blk *y, Index ny) {
+	// Any nonzero block of x above ny makes x the larger.
+	Index i;
+	for (i = nx; i > ny; i--)
+		if (x[i - 1] != 0)
+			break;
+	if (i > ny || compareBlocks(x, y, ny) != less) {
+		Blk borrow = subBlocks(r, x, y, ny);
+		for (i = ny; i < nx; i++)
+			r[i] = subBorrowBlk(x[i], 0, borrow);
+		return false;
+	} else {
+		// The top nx - ny blocks of x are zero, so those of |x - y| are too.
+		subBlocks(r, y, x, ny);
+		for (i = ny; i < nx; i++)
+			r[i] = 0;
+		return true;
+	}
+}
+
+bool BigUnsigned::addSignedBlocks(Blk *r, const Blk *x, Index nx,
+		bool negX, const Blk *y, Index ny, bool negY) {
+	if (negX != negY)
+		return absDiffBlocks(r, x, nx, y, ny) ? negY : negX;
+	Blk carry = addBlocks(r, x, y, ny);
+	Index i;
+	for (i = ny; i < nx; i++)
+		r[i] = x[i];
+	addBlockToBlocks(r + ny, nx - ny, carry);
+	return negX;
+}
+
+/* Exact division works from the bottom up: if r = 3q, the low block of q
+ * is the low block of r times the inverse of 3 mod 2^N, and the high
+ * block of 3 times it is what the next block of r has to absorb. */
+void BigUnsigned::divExactBy3Blocks(Blk *r, Index n) {
+	const Blk inv3 = ~Blk(0) / 3 * 2 + 1;
+	Blk c = 0, hi, q;
+	Index i;
+	for (i = 0; i < n; i++) {
+		Blk borrow = (r[i] < c);
+		q = (r[i] - c) * inv3;
+		r[i] = q;
+		mulBlk(q, 3, hi);
+		c = hi + borrow;
+	}
+}
+
+#ifndef BIGUNSIGNED_KARATSUBA_THRESHOLD
+#define BIGUNSIGNED_KARATSUBA_THRESHOLD 32
+#endif
+
+BigUnsigned::Index BigUnsigned::karatsubaThreshold =
+	BIGUNSIGNED_KARATSUBA_THRESHOLD;
+
+#ifndef BIGUNSIGNED_TOOM3_THRESHOLD
+#define BIGUNSIGNED_TOOM3_THRESHOLD 192
+#endif
+
+BigUnsigned::Index BigUnsigned::toom3Threshold =
+	BIGUNSIGNED_TOOM3_THRESHOLD;
+
+#ifndef BIGUNSIGNED_NTT_THRESHOLD
+#define BIGUNSIGNED_NTT_THRESHOLD 2048
+#endif
+
+BigUnsigned::Index BigUnsigned::nttThreshold = BIGUNSIGNED_NTT_THRESHOLD;
+
+#ifndef BIGUNSIGNED_NEWTON_DIVISION_THRESHOLD
+#define BIGUNSIGNED_NEWTON_DIVISION_THRESHOLD 512
+#endif
+
+BigUnsigned::Index BigUnsigned::newtonDivisionThreshold =
+	BIGUNSIGNED_NEWTON_DIVISION_THRESHOLD;
+
+/*
+ * KARATSUBA MULTIPLICATION
+ *
+ * Split each n-block operand at m = ceil(n / 2) blocks, so that
+ * a = a1 * B^m + a0 and b = b1 * B^m + b0, where B = 2^N.  Then
+ *
+ *    a * b = z2 * B^(2m) + (z0 + z2 - t * s) * B^m + z0,
+ *
+ * where z0 = a0 * b0, z2 = a1 * b1, t = |a0 - a1| * |b0 - b1| and s is the
+ * sign of (a0 - a1) * (b0 - b1).  That is three half-size products instead
+ * of four, and using the absolute differences instead of the sums a0 + a1
+ * keeps every operand at m blocks with no carry block.
+ *
+ * z0 and z2 are built right where they belong in r.  The differences, t
+ * and the middle term live in scratch, laid out as
+ *
+ *    [ |a0 - a1| : m ][ |b0 - b1| : m ][ t : 2m ][ recursion or middle ]
+ *
+ * The recursion for t runs before the middle term is formed, so the two
+ * share the last region.  The caller allocates karatsubaScratchSize(n)
+ * blocks once for the whole recursion.
+ */
+BigUnsigned::Index BigUnsigned::karatsubaScratchSize(Index n) {
+	if (n < effectiveKaratsubaThreshold())
+		return 0;
+	if (n >= effectiveNTTThreshold())
+		return nttScratchSize(n, n);
+	if (n >= effectiveToom3Threshold())
+		return toom3ScratchSize(n);
+	Index m = (n + 1) / 2;
+	Index rest = karatsubaScratchSize(m);
+	if (rest < 2 * m + 1)
+		rest = 2 * m + 1;
+	return 4 * m + rest;
+}
+
+void BigUnsigned::karatsubaBlocks(Blk *r, const Blk *a, const Blk *b,
+		Index n, Blk *scratch) {
+	if (n < effectiveKaratsubaThreshold()) {
+		multiplyBlocksBasecase(r, a, n, b, n);
+		return;
+	}
+	if (n >= effectiveNTTThreshold()) {
+		nttMultiplyBlocks(r, a, n, b, n, scratch);
+		return;
+	}
+	if (n >= effectiveToom3Threshold()) {
+		toom3Blocks(r, a, b, n, scratch);
+		return;
+	}
+	Index m = (n + 1) / 2, h = n - m;
+	Blk *da = scratch, *db = scratch + m, *t = scratch + 2 * m,
+		*rest = scratch + 4 * m;
+	// z0 and z2
+	karatsubaBlocks(r, a, b, m, rest);
+	karatsubaBlocks(r + 2 * m, a + m, b + m, h, rest);
+	// t and its sign
+	bool negA = absDiffBlocks(da, a, m, a + m, h);
+	bool negB = absDiffBlocks(db, b, m, b + m, h);
+	karatsubaBlocks(t, da, db, m, rest);
+	// mid = z0 + z2 - t * s, which is a0 * b1 + a1 * b0 and fits in 2m + 1.
+	Blk *mid = rest;
+	Index i;
+	for (i = 0; i < 2 * m; i++)
+		mid[i] = r[i];
+	Blk carry = addBlocks(mid, mid, r + 2 * m, 2 * h);
+	mid[2 * m] = addBlockToBlocks(mid + 2 * h, 2 * (m - h), carry);
+	if (negA == negB)
+		mid[2 * m] -= subBlocks(mid, mid, t, 2 * m);
+	else
+		mid[2 * m] += addBlocks(mid, mid, t, 2 * m);
+	/* Add the middle term in at block m.  The product fits in 2n blocks,
+	 * so whatever doesn't fit in r is zero and any carry dies inside r. */
+	Index midLen = (2 * m + 1 <= 2 * n - m) ? 2 * m + 1 : 2 * n - m;
+	carry = addBlocks(r + m, r + m, mid, midLen);
+	addBlockToBlocks(r + m + midLen, 2 * n - m - midLen, carry);
+}
+
+/*
+ * TOOM-3 MULTIPLICATION
+ *
+ * Split each n-block operand into three pieces of k = ceil(n / 3) blocks,
+ * the top one h = n - 2k blocks long, so that a(x) = a2 x^2 + a1 x + a0
+ * with a = a(B^k), and likewise b(x).  The product c(x) = a(x) b(x) has
+ * degree 4, so its five coefficients follow from the five products
+ *
+ *    c(0) = a0 b0,  c(1),  c(-1),  c(-2),  c(inf) = a2 b2,
+ *
+ * of pieces about a third the size: five multiplications where Karatsuba
+ * would do nine.  The evaluations are those of Bodrato,
+ *
+ *    p = a0 + a2,  a(1) = p + a1,  a(-1) = p - a1,
+ *    a(-2) = 2 (a(-1) + a2) - a0,
+ *
+ * each of which fits in k + 1 blocks, and the interpolation is
+ *
+ *    c3 = (c(-2) - c(1)) / 3
+ *    c1 = (c(1) - c(-1)) / 2
+ *    c2 = c(-1) - c(0)
+ *    c3 = (c2 - c3) / 2 + 2 c(inf)
+ *    c2 = c2 + c1 - c(inf)
+ *    c1 = c1 - c3,
+ *
+ * where the divisions are exact.  a(-1), a(-2) and the intermediate values
+ * can be negative, so they are kept as a magnitude in blocks plus a sign.
+ *
+ * c(0) and c(inf) are built right where they belong in r, and the scratch
+ * space is laid out as
+ *
+ *    [ a(1), a(-1), a(-2) : 3 (k + 1) ][ b(1), b(-1), b(-2) : 3 (k + 1) ]
+ *    [ c(1), c(-1), c(-2) : 3 (2k + 2) ][ recursion ]
+ *
+ * The pieces are multiplied with karatsubaBlocks, which comes back here
+ * if they are still above the threshold.
+ */
+
+/* Stores a(1), |a(-1)| and |a(-2)| of the n = 2k + h blocks at a, each in
+ * k + 1 blocks.  Returns the sign of a(-1) and sets negM2 to that of
+ * a(-2). */
+bool BigUnsigned::toom3Evaluate(Blk *p1, Blk *pm1, Blk *pm2, bool &negM2,
+		const Blk *a, Index k, Index h) {
+	const Blk *a0 = a, *a1 = a + k, *a2 = a + 2 * k;
+	Index i;
+	// p = a0 + a2, held in p1 until a1 is added
+	for (i = 0; i < k; i++)
+		p1[i] = a0[i];
+	p1[k] = addBlockToBlocks(p1 + h, k - h, addBlocks(p1, p1, a2, h));
+	bool negM1 = absDiffBlocks(pm1, p1, k + 1, a1, k);
+	p1[k] += addBlocks(p1, p1, a1, k);
+	// a(-2) = 2 (a(-1) + a2) - a0; the magnitudes stay below 6 B^k.
+	bool neg = addSignedBlocks(pm2, pm1, k + 1, negM1, a2, h, false);
+	addBlocks(pm2, pm2, pm2, k + 1);
+	negM2 = addSignedBlocks(pm2, pm2, k + 1, neg, a0, k, true);
+	return negM1;
+}
+
+/* Finishes a Toom-3 product of two n-block operands.  r holds c(0) in its
+ * low 2k blocks and c(inf) from block 4k up, and r1, rm1 and rm2 hold
+ * c(1), |c(-1)| and |c(-2)| in 2k + 2 blocks each.  Those three are
+ * overwritten. */
+void BigUnsigned::toom3Interpolate(Blk *r, Index n, Index k, Blk *r1,
+		Blk *rm1, bool negM1, Blk *rm2, bool negM2) {
+	Index len = 2 * k + 2, infLen = 2 * n - 4 * k, i;
+	const Blk *c0 = r, *cInf = r + 4 * k;
+	// rm2 becomes c3, rm1 becomes c2 and r1 becomes c1.
+	bool neg3 = addSignedBlocks(rm2, rm2, len, negM2, r1, len, true);
+	divExactBy3Blocks(rm2, len);
+	bool neg1 = addSignedBlocks(r1, r1, len, false, rm1, len, !negM1);
+	for (i = 0; i + 1 < len; i++)
+		r1[i] = (r1[i] >> 1) | (r1[i + 1] << (N - 1));
+	r1[i] >>= 1;
+	bool neg2 = addSignedBlocks(rm1, rm1, len, negM1, c0, 2 * k, true);
+	neg3 = addSignedBlocks(rm2, rm1, len, neg2, rm2, len, !neg3);
+	for (i = 0; i + 1 < len; i++)
+		rm2[i] = (rm2[i] >> 1) | (rm2[i + 1] << (N - 1));
+	rm2[i] >>= 1;
+	neg3 = addSignedBlocks(rm2, rm2, len, neg3, cInf, infLen, false);
+	neg3 = addSignedBlocks(rm2, rm2, len, neg3, cInf, infLen, false);
+	neg2 = addSignedBlocks(rm1, rm1, len, neg2, r1, len, neg1);
+	neg2 = addSignedBlocks(rm1, rm1, len, neg2, cInf, infLen, true);
+	addSignedBlocks(r1, r1, len, neg1, rm2, len, !neg3);
+	/* c1, c2 and c3 are coefficients of the product, so they are not
+	 * negative, and each one times its power of B fits in 2n blocks.
+	 * Whatever of them lies past r is zero. */
+	for (i = 2 * k; i < 4 * k; i++)
+		r[i] = 0;
+	Blk *c[3] = { r1, rm1, rm2 };
+	Index j, off, cLen;
+	for (j = 0; j < 3; j++) {
+		off = (j + 1) * k;
+		cLen = (len <= 2 * n - off) ? len : 2 * n - off;
+		Blk carry = addBlocks(r + off, r + off, c[j], cLen);
+		addBlockToBlocks(r + off + cLen, 2 * n - off - cLen, carry);
+	}
+}
+
+BigUnsigned::Index BigUnsigned::toom3ScratchSize(Index n) {
+	Index k = (n + 2) / 3, h = n - 2 * k;
+	Index rest = karatsubaScratchSize(k + 1);
+	if (karatsubaScratchSize(k) > rest)
+		rest = karatsubaScratchSize(k);
+	if (karatsubaScratchSize(h) > rest)
+		rest = karatsubaScratchSize(h);
+	return 6 * (k + 1) + 3 * (2 * k + 2) + rest;
+}
+
+void BigUnsigned::toom3Blocks(Blk *r, const Blk *a, const Blk *b, Index n,
+		Blk *scratch) {
+	Index k = (n + 2) / 3, h = n - 2 * k;
+	Blk *pa = scratch, *pb = pa + 3 * (k + 1), *c = pb + 3 * (k + 1),
+		*rest = c + 3 * (2 * k + 2);
+	Index len = 2 * k + 2;
+	bool negA2, negB2;
+	bool negA1 = toom3Evaluate(pa, pa + k + 1, pa + 2 * (k + 1), negA2,
+		a, k, h);
+	bool negB1 = toom3Evaluate(pb, pb + k + 1, pb + 2 * (k + 1), negB2,
+		b, k, h);
+	karatsubaBlocks(c, pa, pb, k + 1, rest);
+	karatsubaBlocks(c + len, pa + k + 1, pb + k + 1, k + 1, rest);
+	karatsubaBlocks(c + 2 * len, pa + 2 * (k + 1), pb + 2 * (k + 1), k + 1,
+		rest);
+	karatsubaBlocks(r, a, b, k, rest);
+	karatsubaBlocks(r + 4 * k, a + 2 * k, b + 2 * k, h, rest);
+	toom3Interpolate(r, n, k, c, c + len, negA1 != negB1, c + 2 * len,
+		negA2 != negB2);
+}
+
+/*
+ * NUMBER-THEORETIC TRANSFORM MULTIPLICATION
+ *
+ * Read the blocks of a and b as the coefficients of polynomials a(x) and
+ * b(x), so that a * b = c(B) for c(x) = a(x) b(x).  Each coefficient of c
+ * is a sum of at most min(na, nb) products of two blocks, which is less
+ * than the product of the three primes
+ *
+ *    p0 = 29 * 2^57 + 1,  p1 = 69 * 2^55 + 1,  p2 = 27 * 2^56 + 1
+ *
+ * (about 2^184) for any operands that fit in memory.  So c is found
+ * modulo each prime as a cyclic convolution of length len, the first
+ * power of two of at least na + nb: transform a and b, multiply pointwise
+ * and transform back.  Each p - 1 has a large power of two as a factor,
+ * so there are roots of unity of every order len needs.  Garner's method
+ * then rebuilds each coefficient from its residues,
+ *
+ *    c = v0 + v1 p0 + v2 p0 p1,  v0 = c mod p0,
+ *    v1 = (c - v0) / p0 mod p1,  v2 = (c - v0 - v1 p0) / (p0 p1) mod p2,
+ *
+ * and adds it in at its place in r.  The scratch space is laid out as
+ *
+ *    [ a : len ][ b : len ][ twiddles : len ][ c mod p0 : len ]
+ *    [ c mod p1 : len ]
+ *
+ * and c mod p2 is left where a was.
+ */
+BigUnsigned::NTTPrime::NTTPrime(Blk p, Blk root)
+		: p(p), twoP(2 * p), root(root) {
+	// Each step doubles the correct low bits, and p is its own inverse mod 8.
+	Blk inv = p;
+	int i;
+	for (i = 0; i < 5; i++)
+		inv *= 2 - p * inv;
+	pInv = 0 - inv;
+	one = (~Blk(0) % p + 1) % p;
+	// Doubling R mod p 64 times gives R^2 mod p.
+	rr = one;
+	for (i = 0; i < 64; i++)
+		rr = add(rr, rr);
+}
+
+inline BigUnsigned::Blk BigUnsigned::NTTPrime::mulLazy(Blk a,
+		Blk b) const {
+	Blk hi, mhi;
+	Blk lo = mulBlk(a, b, hi);
+	mulBlk(lo * pInv, p, mhi);
+	// The low blocks cancel, carrying out exactly when lo is nonzero.
+	return hi + mhi + (lo != 0);
+}
+
+BigUnsigned::Blk BigUnsigned::NTTPrime::pow(Blk x, Blk e) const {
+	Blk r = one;
+	for (; e != 0; e >>= 1) {
+		if (e & 1)
+			r = mul(r, x);
+		x = mul(x, x);
+	}
+	return r;
+}
+
+void BigUnsigned::nttTwiddles(const NTTPrime &f, Blk *w, Index len) {
+	Blk g = f.mul(f.root, f.rr);
+	Index h, j;
+	for (h = 1; h < len; h <<= 1) {
+		Blk step = f.pow(g, (f.p - 1) / (2 * Blk(h)));
+		w[h] = f.one;
+		for (j = 1; j < h; j++)
+			w[h + j] = f.mul(w[h + j - 1], step);
+	}
+}
+
+/* Decimation in frequency (Gentleman-Sande butterflies).  Takes and
+ * leaves values below 2p. */
+void BigUnsigned::nttForward(const NTTPrime &f, Blk *x, Index len,
+		const Blk *w) {
+	Index h, i, j;
+	for (h = len / 2; h >= 1; h >>= 1)
+		for (i = 0; i < len; i += 2 * h)
+			for (j = 0; j < h; j++) {
+				Blk u = x[i + j], v = x[i + j + h];
+				Blk sum = u + v;
+				x[i + j] = (sum >= f.twoP) ? sum - f.twoP : sum;
+				x[i + j + h] = f.mulLazy(u - v + f.twoP, w[h + j]);
+			}
+}
+
+/* Decimation in time (Cooley-Tukey butterflies) with the inverse roots.
+ * The inverse of the j-th power of a root of order 2h is minus its
+ * (h - j)-th power, which is w[2h - j]; the minus swaps the sum and the
+ * difference.  The result is len times the original.  Takes and leaves
+ * values below 2p. */
+void BigUnsigned::nttInverse(const NTTPrime &f, Blk *x, Index len,
+		const Blk *w) {
+	Index h, i, j;
+	Blk u, v, sum, diff;
+	for (h = 1; h < len; h <<= 1)
+		for (i = 0; i < len; i += 2 * h)
+			for (j = 0; j < h; j++) {
+				u = x[i + j];
+				if (j == 0) {
+					v = x[i + h];
+					sum = u + v;
+					diff = u - v + f.twoP;
+				} else {
+					v = f.mulLazy(x[i + j + h], w[2 * h - j]);
+					sum = u - v + f.twoP;
+					diff = u + v;
+				}
+				x[i + j] = (sum >= f.twoP) ? sum - f.twoP : sum;
+				x[i + j + h] = (diff >= f.twoP) ? diff - f.twoP : diff;
+			}
+}
+
+BigUnsigned::Index BigUnsigned::nttScratchSize(Index na, Index nb) {
+	Index len = 1;
+	while (len < na + nb)
+		len <<= 1;
+	return 5 * len;
+}
+
+void BigUnsigned::nttMultiplyBlocks(Blk *r, const Blk *a, Index na,
+		const Blk *b, Index nb, Blk *scratch) {
+	static const unsigned long long primes[3] = {
+		0x3a00000000000001ULL, 0x2280000000000001ULL, 0x1b00000000000001ULL
+	};
+	static const Blk roots[3] = { 3, 5, 5 };
+	bool square = (a == b && na == nb);
+	Index len = 1, i, j;
+	while (len < na + nb)
+		len <<= 1;
+	Blk *x = scratch, *y = x + len, *w = y + len;
+	Blk *res[3] = { w + len, w + 2 * len, x };
+	for (i = 0; i < 3; i++) {
+		NTTPrime f(Blk(primes[i]), roots[i]);
+		nttTwiddles(f, w, len);
+		// Converting to Montgomery form also reduces the blocks mod p.
+		for (j = 0; j < na; j++)
+			x[j] = f.mul(a[j], f.rr);
+		for (; j < len; j++)
+			x[j] = 0;
+		nttForward(f, x, len, w);
+		if (square) {
+			for (j = 0; j < len; j++)
+				x[j] = f.mulLazy(x[j], x[j]);
+		} else {
+			for (j = 0; j < nb; j++)
+				y[j] = f.mul(b[j], f.rr);
+			for (; j < len; j++)
+				y[j] = 0;
+			nttForward(f, y, len, w);
+			for (j = 0; j < len; j++)
+				x[j] = f.mulLazy(x[j], y[j]);
+		}
+		nttInverse(f, x, len, w);
+		/* The inverse transform leaves len times c in Montgomery form, and
+		 * multiplying by len^(-1) takes out both factors. */
+		Blk scale = f.mul(f.pow(f.mul(Blk(len), f.rr), f.p - 2), 1);
+		for (j = 0; j < len; j++)
+			res[i][j] = f.mul(x[j], scale);
+	}
+	// Garner's constants, in Montgomery form where they are multipliers
+	NTTPrime f1(Blk(primes[1]), roots[1]), f2(Blk(primes[2]), roots[2]);
+	Blk p0 = Blk(primes[0]), p1 = Blk(primes[1]), p2 = Blk(primes[2]);
+	Blk inv0 = f1.pow(f1.mul(p0, f1.rr), p1 - 2);
+	Blk p0In2 = f2.mul(p0, f2.rr);
+	Blk inv01 = f2.pow(f2.mul(p0In2, f2.mul(p1, f2.rr)), p2 - 2);
+	Blk q1, q0 = mulBlk(p0, p1, q1);
+	// acc holds the part of r not yet written, shifted down to block k.
+	Blk acc0 = 0, acc1 = 0, acc2 = 0;
+	for (j = 0; j < na + nb; j++) {
+		/* p0 < 2 p1 < 3 p2 and p1 < 2 p2, so a subtraction or two reduces
+		 * v0 and v1 mod the smaller primes. */
+		Blk v0 = res[0][j], v0In1 = v0, v0In2 = v0;
+		if (v0In1 >= p1)
+			v0In1 -= p1;
+		while (v0In2 >= p2)
+			v0In2 -= p2;
+		Blk v1 = f1.mul(f1.sub(res[1][j], v0In1), inv0);
+		Blk v1In2 = (v1 >= p2) ? v1 - p2 : v1;
+		Blk v2 = f2.mul(f2.sub(res[2][j],
+			f2.add(v0In2, f2.mul(v1In2, p0In2))), inv01);
+		// (e2, e1, e0) = v0 + v1 p0 + v2 (q1, q0)
+		Blk h, carry = 0, t1, s1;
+		Blk e0 = mulBlk(v1, p0, h);
+		e0 = addCarryBlk(e0, v0, carry);
+		Blk e1 = h + carry;
+		Blk t0 = mulBlk(v2, q0, t1), s0 = mulBlk(v2, q1, s1);
+		carry = 0;
+		e0 = addCarryBlk(e0, t0, carry);
+		e1 = addCarryBlk(e1, t1, carry);
+		Blk e2 = s1 + carry;
+		carry = 0;
+		e1 = addCarryBlk(e1, s0, carry);
+		e2 += carry;
+		carry = 0;
+		r[j] = addCarryBlk(acc0, e0, carry);
+		acc0 = addCarryBlk(acc1, e1, carry);
+		acc1 = addCarryBlk(acc2, e2, carry);
+		acc2 = carry;
+	}
+}
+
+/* Scratch needed by multiplyBlocks.  Mirrors its case analysis: long
+ * operands go to the transform, balanced ones to Karatsuba, and unbalanced
+ * ones are multiplied a chunk of nb blocks of the longer operand at a
+ * time, with each chunk's product built in a 2nb-block buffer and added in
+ * place. */
+BigUnsigned::Index BigUnsigned::multiplyScratchSize(Index na, Index nb) {
+	if (na < nb) {
+		Index t = na;
+		na = nb;
+		nb = t;
+	}
+	if (nb < effectiveKaratsubaThreshold())
+		return 0;
+	if (nb >= effectiveNTTThreshold())
+		return nttScratchSize(na, nb);
+	if (na == nb)
+		return karatsubaScratchSize(nb);
+	Index rest = karatsubaScratchSize(nb), rem = na % nb;
+	if (rem != 0 && multiplyScratchSize(nb, rem) > rest)
+		rest = multiplyScratchSize(nb, rem);
+	return 2 * nb + rest;
+}
+
+void BigUnsigned::multiplyBlocks(Blk *r, const Blk *a, Index na,
+		const Blk *b, Index nb, Blk *scratch) {
+	if (na < nb) {
+		const Blk *t = a;
+		a = b;
+		b = t;
+		Index tn = na;
+		na = nb;
+		nb = tn;
+	}
+	if (nb < effectiveKaratsubaThreshold()) {
+		multiplyBlocksBasecase(r, a, na, b, nb);
+		return;
+	}
+	if (nb >= effectiveNTTThreshold()) {
+		nttMultiplyBlocks(r, a, na, b, nb, scratch);
+		return;
+	}
+	if (na == nb) {
+		karatsubaBlocks(r, a, b, nb, scratch);
+		return;
+	}
+	// The first chunk's product goes straight into r.
+	karatsubaBlocks(r, a, b, nb, scratch);
+	Blk *chunk = scratch, *rest = scratch + 2 * nb;
+	Index off, chunkLen, i;
+	for (off = nb; off < na; off += nb) {
+		chunkLen = (na - off < nb) ? na - off : nb;
+		if (chunkLen == nb)
+			karatsubaBlocks(chunk, a + off, b, nb, rest);
+		else
+			multiplyBlocks(chunk, b, nb, a + off, chunkLen, rest);
+		/* r[off, off + nb) holds the top half of the previous product and
+		 * r[off + nb, ...) is untouched so far. */
+		Blk carry = addBlocks(r + off, r + off, chunk, nb);
+		for (i = nb; i < nb + chunkLen; i++)
+			r[off + i] = chunk[i];
+		addBlockToBlocks(r + off + nb, chunkLen, carry);
+	}
+}
+
+/*
+ * SQUARING
+ *
+ * In column k of a * a, the products a[i] * a[k - i] and a[k - i] * a[i]
+ * are equal, so the basecase sums each one once into a second accumulator,
+ * doubles that with a one-bit shift, and adds the diagonal term a[k/2]^2
+ * for even k.  That is about half the block multiplications of
+ * multiplyBlocksBasecase.
+ */
+void BigUnsigned::squareBlocksBasecase(Blk *r, const Blk *a, Index n) {
+	Blk c0 = 0, c1 = 0, c2 = 0, d0, d1, d2;
+	Index i, j, k;
+	for (k = 0; k < 2 * n - 1; k++) {
+		d0 = d1 = d2 = 0;
+		i = (k >= n) ? k - n + 1 : 0;
+		for (j = k - i; i < j; i++, j--)
+			mulAccBlk(a[i], a[j], d0, d1, d2);
+		// Double the cross products; d2 is small, so nothing is lost.
+		d2 = (d2 << 1) | (d1 >> (N - 1));
+		d1 = (d1 << 1) | (d0 >> (N - 1));
+		d0 <<= 1;
+		if (i == j)
+			mulAccBlk(a[i], a[i], d0, d1, d2);
+		// Add the column into the running accumulator.
+		c0 += d0;
+		d1 += (c0 < d0);
+		d2 += (d1 == 0 && c0 < d0);
+		c1 += d1;
+		c2 += d2 + (c1 < d1);
+		r[k] = c0;
+		c0 = c1;
+		c1 = c2;
+		c2 = 0;
+	}
+	r[k] = c0;
+}
+
+/* Karatsuba squaring: with a = a1 * B^m + a0,
+ *
+ *    a^2 = a1^2 * B^(2m) + (a0^2 + a1^2 - (a0 - a1)^2) * B^m + a0^2,
+ *
+ * and the middle term is always a subtraction.  The scratch layout is
+ * that of karatsubaBlocks without the second difference. */
+BigUnsigned::Index BigUnsigned::squareScratchSize(Index n) {
+	if (n < effectiveKaratsubaThreshold())
+		return 0;
+	if (n >= effectiveNTTThreshold())
+		return nttScratchSize(n, n);
+	if (n >= effectiveToom3Threshold())
+		return toom3SquareScratchSize(n);
+	Index m = (n + 1) / 2;
+	Index rest = squareScratchSize(m);
+	if (rest < 2 * m + 1)
+		rest = 2 * m + 1;
+	return 3 * m + rest;
+}
+
+void BigUnsigned::squareBlocks(Blk *r, const Blk *a, Index n, Blk *scratch) {
+	if (n < effectiveKaratsubaThreshold()) {
+		squareBlocksBasecase(r, a, n);
+		return;
+	}
+	if (n >= effectiveNTTThreshold()) {
+		nttMultiplyBlocks(r, a, n, a, n, scratch);
+		return;
+	}
+	if (n >= effectiveToom3Threshold()) {
+		toom3SquareBlocks(r, a, n, scratch);
+		return;
+	}
+	Index m = (n + 1) / 2, h = n - m;
+	Blk *da = scratch, *t = scratch + m, *rest = scratch + 3 * m;
+	squareBlocks(r, a, m, rest);
+	squareBlocks(r + 2 * m, a + m, h, rest);
+	absDiffBlocks(da, a, m, a + m, h);
+	squareBlocks(t, da, m, rest);
+	Blk *mid = rest;
+	Index i;
+	for (i = 0; i < 2 * m; i++)
+		mid[i] = r[i];
+	Blk carry = addBlocks(mid, mid, r + 2 * m, 2 * h);
+	mid[2 * m] = addBlockToBlocks(mid + 2 * h, 2 * (m - h), carry);
+	mid[2 * m] -= subBlocks(mid, mid, t, 2 * m);
+	Index midLen = (2 * m + 1 <= 2 * n - m) ? 2 * m + 1 : 2 * n - m;
+	carry = addBlocks(r + m, r + m, mid, midLen);
+	addBlockToBlocks(r + m + midLen, 2 * n - m - midLen, carry);
+}
+
+/* Toom-3 squaring evaluates a once and squares the evaluations, so the
+ * scratch space has no room for those of b and c(-1) and c(-2) are never
+ * negative. */
+BigUnsigned::Index BigUnsigned::toom3SquareScratchSize(Index n) {
+	Index k = (n + 2) / 3, h = n - 2 * k;
+	Index rest = squareScratchSize(k + 1);
+	if (squareScratchSize(k) > rest)
+		rest = squareScratchSize(k);
+	if (squareScratchSize(h) > rest)
+		rest = squareScratchSize(h);
+	return 3 * (k + 1) + 3 * (2 * k + 2) + rest;
+}
+
+void BigUnsigned::toom3SquareBlocks(Blk *r, const Blk *a, Index n,
+		Blk *scratch) {
+	Index k = (n + 2) / 3, h = n - 2 * k;
+	Blk *pa = scratch, *c = pa + 3 * (k + 1), *rest = c + 3 * (2 * k + 2);
+	Index len = 2 * k + 2;
+	bool negA2;
+	toom3Evaluate(pa, pa + k + 1, pa + 2 * (k + 1), negA2, a, k, h);
+	squareBlocks(c, pa, k + 1, rest);
+	squareBlocks(c + len, pa + k + 1, k + 1, rest);
+	squareBlocks(c + 2 * len, pa + 2 * (k + 1), k + 1, rest);
+	squareBlocks(r, a, k, rest);
+	squareBlocks(r + 4 * k, a + 2 * k, h, rest);
+	toom3Interpolate(r, n, k, c, c + len, false, c + 2 * len, false);
+}
+
+void BigUnsigned::square(const BigUnsigned &a) {
+	/* The result would overwrite blocks of a that later columns still
+	 * need. */
+	DTRT_ALIASED_UNS(this == &a, square(a));
+	if (a.len == 0) {
+		len = 0;
+		return;
+	}
+	Index n = a.len;
+	Index scratchLen = squareScratchSize(n);
+	Blk *scratch = (scratchLen > 0) ? new Blk[scratchLen] : NULL;
+	allocate(2 * n);
+	squareBlocks(blk, a.blk, n, scratch);
+	delete [] scratch;
+	len = 2 * n;
+	// Zap possible leading zero
+	if (blk[len - 1] == 0)
+		len--;
+}
+
+void BigUnsigned::multiply(const BigUnsigned &a, const BigUnsigned &b) {
+	DTRT_ALIASED_UNS(this == &a || this == &b, multiply(a, b));
+	// If either a or b is zero, set to zero.
+	if (a.len == 0 || b.len == 0) {
+		len = 0;
+		return;
+	}
+	// Set preliminary length and make room
+	len = a.len + b.len;
+	allocate(len);
+	// Large operands need scratch space, allocated once for the recursion.
+	Index scratchLen = multiplyScratchSize(a.len, b.len);
+	Blk *scratch = (scratchLen > 0) ? new Blk[scratchLen] : NULL;
+	multiplyBlocks(blk, a.blk, a.len, b.blk, b.len, scratch);
+	delete [] scratch;
+	// Zap possible leading zero
+	if (blk[len - 1] == 0)
+		len--;
+}
+
+void BigUnsigned::multiplyAdd(const BigUnsigned &a, const BigUnsigned &b,
+		const BigUnsigned &c) {
+	// Let b be the shorter factor.
+	if (a.len < b.len) {
+		multiplyAdd(b, a, c);
+		return;
+	}
+	if (b.len == 0) {
+		operator =(c);
+		return;
+	}
+	if (b.len > 1) {
+		DTRT_ALIASED_UNS(this == &a || this == &b, multiplyAdd(a, b, c));
+		if (this != &c) {
+			multiply(a, b);
+			accumulate(c.blk, c.len);
+		} else if (b.len < effectiveKaratsubaThreshold()) {
+			// Add a * b[j] into *this at block j, for each j.
+			Index n = (a.len + b.len > len) ? a.len + b.len : len, i, j;
+			allocateAndCopy(n + 1);
+			for (i = len; i <= n; i++)
+				blk[i] = 0;
+			for (j = 0; j < b.len; j++) {
+				Blk carry = mulAddBlocks(blk + j, a.blk, a.len, b.blk[j]);
+				addBlockToBlocks(blk + j + a.len, n + 1 - j - a.len, carry);
+			}
+			len = n + 1;
+			zapLeadingZeros();
+		} else {
+			// The faster multiplications need somewhere else to write.
+			Index np = a.len + b.len;
+			BigUnsigned p(0, np + multiplyScratchSize(a.len, b.len));
+			multiplyBlocks(p.blk, a.blk, a.len, b.blk, b.len, p.blk + np);
+			accumulate(p.blk, np);
+		}
+		return;
+	}
+	/* One pass: block i of *this is a[i] * m + c[i] plus the carry from
+	 * block i - 1.  Both inputs are read at i before block i is written,
+	 * so *this may be a or c as long as their blocks are kept. */
+	Blk m = b.blk[0];
+	Index na = a.len, nc = c.len, n = (na > nc) ? na : nc, i;
+	if (this == &a || this == &c)
+		allocateAndCopy(n + 1);
+	else
+		allocate(n + 1);
+	const Blk *x = a.blk, *y = c.blk;
+	Blk carry = 0;
+	for (i = 0; i < na && i < nc; i++)
+		blk[i] = mulAddBlk(x[i], m, y[i], carry);
+	for (; i < na; i++)
+		blk[i] = mulAddBlk(x[i], m, 0, carry);
+	for (; i < nc; i++) {
+		blk[i] = y[i] + carry;
+		carry = (blk[i] < carry);
+	}
+	blk[n] = carry;
+	len = n + 1;
+	zapLeadingZeros();
+}
+
+void BigUnsigned::accumulate(const Blk *x, Index nx) {
+	Index n = (len > nx) ? len : nx, i;
+	allocateAndCopy(n + 1);
+	for (i = len; i <= n; i++)
+		blk[i] = 0;
+	Blk carry = addBlocks(blk, blk, x, nx);
+	addBlockToBlocks(blk + nx, n + 1 - nx, carry);
+	len = n + 1;
+	zapLeadingZeros();
+}
+
+void BigUnsigned::multiplyModulo(const BigUnsigned &a, const BigUnsigned &b,
+		const BigUnsigned &m) {
+	DTRT_ALIASED_UNS(this == &m, multiplyModulo(a, b, m));
+	// The product is made in *this and reduced where it lies.
+	multiply(a, b);
+	reduceModulo(m);
+}
+
+void BigUnsigned::reduceModulo(const BigUnsigned &b) {
+	if (this == &b) {
 		len = 0;
 		return;
 	}
-	/*
-	 * Overall method:
-	 *
-	 * Set this = 0.
-	 * For each 1-bit of `a' (say the `i2'th bit of block `i'):
-	 *    Add `b << (i blocks and i2 bits)' to *this.
-	 */
-	// Variables for the calculation
-	Index i, j, k;
-	unsigned int i2;
-	Blk temp;
-	bool carryIn, carryOut;
-	// Set preliminary length and make room
-	len = a.len + b.len;
-	allocate(len);
-	// Zero out this object
-	for (i = 0; i < len; i++)
-		blk[i] = 0;
-	// For each block of the first number...
-	for (i = 0; i < a.len; i++) {
-		// For each 1-bit of that block...
-		for (i2 = 0; i2 < N; i2++) {
-			if ((a.blk[i] & (Blk(1) << i2)) == 0)
-				continue;
-			/*
-			 * Add b to this, shifted left i blocks and i2 bits.
-			 * j is the index in b, and k = i + j is the index in this.
-			 *
-			 * `getShiftedBlock', a short inline function defined above,
-			 * is now used for the bit handling.  It replaces the more
-			 * complex `bHigh' code, in which each run of the loop dealt
-			 * immediately with the low bits and saved the high bits to
-			 * be picked up next time.  The last run of the loop used to
-			 * leave leftover high bits, which were handled separately.
-			 * Instead, this loop runs an additional time with j == b.len.
-			 * These changes were made on 2005.01.11.
-			 */
-			for (j = 0, k = i, carryIn = false; j <= b.len; j++, k++) {
-				/*
-				 * The body of this loop is very similar to the body of the first loop
-				 * in `add', except that this loop does a `+=' instead of a `+'.
-				 */
-				temp = blk[k] + getShiftedBlock(b, j, i2);
-				carryOut = (temp < blk[k]);
-				if (carryIn) {
-					temp++;
-					carryOut |= (temp == 0);
-				}
-				blk[k] = temp;
-				carryIn = carryOut;
-			}
-			// No more extra iteration to deal with `bHigh'.
-			// Roll-over a carry as necessary.
-			for (; carryIn; k++) {
-				blk[k]++;
-				carryIn = (blk[k] == 0);
-			}
-		}
+	if (b.len == 0 || len < b.len)
+		return;
+	if (b.len >= effectiveNewtonDivisionThreshold()
+			&& len - b.len + 1 >= effectiveNewtonDivisionThreshold()) {
+		BigUnsigned q;
+		divideNewton(b, q);
+		return;
 	}
-	// Zap possible leading zero
-	if (blk[len - 1] == 0)
-		len--;
+	divideKnuth(b, NULL);
 }
 
 /*
@@ -1448,121 +3852,206 @@ void BigUnsigned::divideWithRemainder(const BigUnsigned &b, BigUnsigned &q) {
 
 	// At this point we know (*this).len >= b.len > 0.  (Whew!)
 
-	/*
-	 * Overall method:
-	 *
-	 * For each appropriate i and i2, decreasing:
-	 *    Subtract (b << (i blocks and i2 bits)) from *this, storing the
-	 *      result in subtractBuf.
-	 *    If the subtraction succeeds with a nonnegative result:
-	 *        Turn on bit i2 of block i of the quotient q.
-	 *        Copy subtractBuf back into *this.
-	 *    Otherwise bit i2 of block i remains off, and *this is unchanged.
-	 * 
-	 * Eventually q will contain the entire quotient, and *this will
-	 * be left with the remainder.
-	 *
-	 * subtractBuf[x] corresponds to blk[x], not blk[x+i], since 2005.01.11.
-	 * But on a single iteration, we don't touch the i lowest blocks of blk
-	 * (and don't use those of subtractBuf) because these blocks are
-	 * unaffected by the subtraction: we are subtracting
-	 * (b << (i blocks and i2 bits)), which ends in at least `i' zero
-	 * blocks. */
-	// Variables for the calculation
-	Index i, j, k;
-	unsigned int i2;
-	Blk temp;
-	bool borrowIn, borrowOut;
+	// Long divisions go by way of the reciprocal of b.
+	if (b.len >= effectiveNewtonDivisionThreshold()
+			&& len - b.len + 1 >= effectiveNewtonDivisionThreshold()) {
+		divideNewton(b, q);
+		return;
+	}
+
+	// Set preliminary length for quotient and make room
+	q.len = len - b.len + 1;
+	q.allocate(q.len);
+	divideKnuth(b, q.blk);
+	// Zap possible leading zero in quotient
+	if (q.blk[q.len - 1] == 0)
+		q.len--;
+}
 
+void BigUnsigned::divideKnuth(const BigUnsigned &b, Blk *q) {
 	/*
-	 * Make sure we have an extra zero block just past the value.
+	 * Overall method: Knuth's Algorithm D (TAOCP 4.3.1).
 	 *
-	 * When we attempt a subtraction, we might shift `b' so
-	 * its first block begins a few bits left of the dividend,
-	 * and then we'll try to compare these extra bits with
-	 * a nonexistent block to the left of the dividend.  The
-	 * extra zero block ensures sensible behavior; we need
-	 * an extra block in `subtractBuf' for exactly the same reason.
+	 * Shift both numbers left so the top bit of b's top block is set.  This
+	 * doesn't change the quotient and multiplies the remainder by the same
+	 * power of 2, which we divide out at the end.  Then, for each quotient
+	 * block j, decreasing:
+	 *    Estimate q_j by dividing the top two blocks of the current
+	 *      remainder by the top block of b.  Thanks to the normalization,
+	 *      the estimate is at most 2 too big; the test against the next
+	 *      block of each catches nearly all of those cases.
+	 *    Subtract (q_j * b) << (j blocks) from *this.
+	 *    If that borrows, q_j was still one too big: add b back.
+	 *
+	 * The remainder is developed in place in blk, which needs one extra
+	 * block for the bits shifted out of the top.
 	 */
-	Index origLen = len; // Save real length.
-	/* To avoid an out-of-bounds access in case of reallocation, allocate
-	 * first and then increment the logical length. */
-	allocateAndCopy(len + 1);
-	len++;
-	blk[origLen] = 0; // Zero the added block.
-
-	// subtractBuf holds part of the result of a subtraction; see above.
-	Blk *subtractBuf = new Blk[len];
+	Index n = b.len, m = len - b.len;
+	Index i, j;
 
-	// Set preliminary length for quotient and make room
-	q.len = origLen - b.len + 1;
-	q.allocate(q.len);
-	// Zero out the quotient
-	for (i = 0; i < q.len; i++)
-		q.blk[i] = 0;
+	// s is the normalization shift.
+	unsigned int s = 0;
+	for (Blk top = b.blk[n - 1]; !(top & (Blk(1) << (N - 1))); top <<= 1)
+		s++;
 
-	// For each possible left-shift of b in blocks...
-	i = q.len;
-	while (i > 0) {
+	// Normalize *this in place, top block first so nothing is overwritten
+	// before it is read.
+	allocateAndCopy(len + 1);
+	for (i = len + 1; i > 0; ) {
 		i--;
-		// For each possible left-shift of b in bits...
-		// (Remember, N is the number of bits in a Blk.)
-		q.blk[i] = 0;
-		i2 = N;
-		while (i2 > 0) {
-			i2--;
-			/*
-			 * Subtract b, shifted left i blocks and i2 bits, from *this,
-			 * and store the answer in subtractBuf.  In the for loop, `k == i + j'.
-			 *
-			 * Compare this to the middle section of `multiply'.  They
-			 * are in many ways analogous.  See especially the discussion
-			 * of `getShiftedBlock'.
-			 */
-			for (j = 0, k = i, borrowIn = false; j <= b.len; j++, k++) {
-				temp = blk[k] - getShiftedBlock(b, j, i2);
-				borrowOut = (temp > blk[k]);
-				if (borrowIn) {
-					borrowOut |= (temp == 0);
-					temp--;
-				}
-				// Since 2005.01.11, indices of `subtractBuf' directly match those of `blk', so use `k'.
-				subtractBuf[k] = temp; 
-				borrowIn = borrowOut;
+		blk[i] = getShiftedBlock(*this, i, s);
+	}
+	// Normalize b into a separate buffer, unless it already is.
+	BigUnsigned vBuf(0, (s != 0) ? n : 0);
+	const Blk *v = b.blk;
+	if (s != 0) {
+		for (i = 0; i < n; i++)
+			vBuf.blk[i] = getShiftedBlock(b, i, s);
+		v = vBuf.blk;
+	}
+
+	Blk *u = blk;
+	Blk vTop = v[n - 1];
+	if (n == 1) {
+		// A one-block divisor needs no estimate: each step is a c_0.
+		Blk r = u[m + 1];
+		for (j = m + 1; j > 0; ) {
+			j--;
+			Blk qj = divBlk(r, u[j], vTop, r);
+			if (q != NULL)
+				q[j] = qj;
+			u[j + 1] = 0;
+		}
+		u[0] = r;
+	} else {
+		Blk vNext = v[n - 2];
+		Blk qhat, rhat, hi, lo;
+		// rhatOverflow is true once rhat reaches B, which ends the test below.
+		bool rhatOverflow;
+		for (j = m + 1; j > 0; ) {
+			j--;
+			/* u[j + n] <= vTop always holds here.  If they are equal, the
+			 * quotient block can't be more than B - 1. */
+			if (u[j + n] >= vTop) {
+				qhat = ~Blk(0);
+				rhat = u[j + n - 1] + vTop;
+				rhatOverflow = (rhat < vTop);
+			} else {
+				qhat = divBlk(u[j + n], u[j + n - 1], vTop, rhat);
+				rhatOverflow = false;
 			}
-			// No more extra iteration to deal with `bHigh'.
-			// Roll-over a borrow as necessary.
-			for (; k < origLen && borrowIn; k++) {
-				borrowIn = (blk[k] == 0);
-				subtractBuf[k] = blk[k] - 1;
+			// While qhat * vNext > (rhat, u[j + n - 2]), qhat is too big.
+			while (!rhatOverflow) {
+				lo = mulBlk(qhat, vNext, hi);
+				if (hi < rhat || (hi == rhat && lo <= u[j + n - 2]))
+					break;
+				qhat--;
+				rhat += vTop;
+				rhatOverflow = (rhat < vTop);
 			}
-			/*
-			 * If the subtraction was performed successfully (!borrowIn),
-			 * set bit i2 in block i of the quotient.
-			 *
-			 * Then, copy the portion of subtractBuf filled by the subtraction
-			 * back to *this.  This portion starts with block i and ends--
-			 * where?  Not necessarily at block `i + b.len'!  Well, we
-			 * increased k every time we saved a block into subtractBuf, so
-			 * the region of subtractBuf we copy is just [i, k).
-			 */
-			if (!borrowIn) {
-				q.blk[i] |= (Blk(1) << i2);
-				while (k > i) {
-					k--;
-					blk[k] = subtractBuf[k];
-				}
-			} 
+			Blk borrow = mulSubBlocks(u + j, v, n, qhat);
+			Blk temp = u[j + n];
+			u[j + n] = temp - borrow;
+			if (borrow > temp) {
+				// Rare: qhat was one too big.  Add one b back.
+				qhat--;
+				u[j + n] += addBlocks(u + j, u + j, v, n);
+			}
+			if (q != NULL)
+				q[j] = qhat;
 		}
 	}
-	// Zap possible leading zero in quotient
-	if (q.blk[q.len - 1] == 0)
-		q.len--;
+
+	// The remainder is in the low n blocks; shift it back down.
+	len = n;
+	if (s != 0)
+		for (i = 0; i < n; i++)
+			blk[i] = (blk[i] >> s) | (blk[i + 1] << (N - s));
 	// Zap any/all leading zeros in remainder
 	zapLeadingZeros();
-	// Deallocate subtractBuf.
-	// (Thanks to Brad Spencer for noticing my accidental omission of this!)
-	delete [] subtractBuf;
+}
+
+/*
+ * NEWTON DIVISION
+ *
+ * For a p-block d with its top bit set, an x with
+ *
+ *    d x < B^(2p) <= d (x + 2),
+ *
+ * so floor(B^(2p) / d) or one less, is found from such a reciprocal xh of
+ * the top h = p - floor((p - 1) / 2) blocks of d by one step of Newton's
+ * iteration for 1 / d, which doubles the number of correct blocks.  The
+ * step works on the residual B^(p+h) - d xh, which is only about h blocks
+ * long, so each level costs a p-by-h and an h-by-h multiplication.  This
+ * is Algorithm 3.5 (ApproximateReciprocal) of Brent and Zimmermann,
+ * "Modern Computer Arithmetic", where the bound is proved.  Short
+ * reciprocals come straight from divideWithRemainder.
+ */
+void BigUnsigned::setReciprocal(const BigUnsigned &d) {
+	Index p = d.len;
+	if (p < effectiveNewtonDivisionThreshold()) {
+		// floor((B^(2p) - 1) / d), which is the largest x with d x < B^(2p)
+		BigUnsigned u(0, 2 * p);
+		Index i;
+		for (i = 0; i < 2 * p; i++)
+			u.blk[i] = ~Blk(0);
+		u.len = 2 * p;
+		u.divideWithRemainder(d, *this);
+		return;
+	}
+	Index l = (p - 1) / 2, h = p - l;
+	BigUnsigned xh, t, bound(1);
+	xh.setReciprocal(BigUnsigned(d.blk + l, h));
+	t.multiply(d, xh);
+	bound <<= int(N * (p + h));
+	while (t >= bound) {
+		xh--;
+		t -= d;
+	}
+	bound -= t;
+	bound >>= int(N * l);
+	t.multiply(bound, xh);
+	t >>= int(N * (2 * h - l));
+	*this = xh << int(N * l);
+	*this += t;
+}
+
+/* With both numbers normalized so that b's top bit is set, let n be the
+ * length of b and k that of the quotient.  Taking the top p = k + 1
+ * blocks of b (padded with zeros if b is shorter) and the top k blocks of
+ * *this,
+ *
+ *    q = floor(top(*this) * reciprocal(top(b)) / B^(p + 1))
+ *
+ * is within a few units of the quotient, since the parts dropped from
+ * either number are too small to move it further.  The remainder of q
+ * then shows which way and how far. */
+void BigUnsigned::divideNewton(const BigUnsigned &b, BigUnsigned &q) {
+	unsigned int s = 0;
+	for (Blk top = b.blk[b.len - 1]; !(top & (Blk(1) << (N - 1))); top <<= 1)
+		s++;
+	BigUnsigned u(*this << int(s)), v(b << int(s));
+	Index n = v.len, k = u.len - n + 1, p = k + 1;
+	BigUnsigned vTop, x;
+	if (n >= p)
+		vTop = BigUnsigned(v.blk + (n - p), p);
+	else
+		vTop = v << int(N * (p - n));
+	x.setReciprocal(vTop);
+	q.multiply(BigUnsigned(u.blk + (n - 1), k), x);
+	q >>= int(N * (p + 1));
+	BigUnsigned qv;
+	qv.multiply(q, v);
+	while (qv > u) {
+		qv -= v;
+		q--;
+	}
+	u -= qv;
+	while (u >= v) {
+		u -= v;
+		q++;
+	}
+	*this = u >> int(s);
 }
 
 /* BITWISE OPERATORS
@@ -1631,6 +4120,11 @@ void BigUnsigned::bitShiftLeft(const BigUnsigned &a, int b) {
 			return;
 		}
 	}
+	// Zero stays zero; the code below would leave a zero block.
+	if (a.len == 0) {
+		len = 0;
+		return;
+	}
 	Index shiftBlocks = b / N;
 	unsigned int shiftBits = b % N;
 	// + 1: room for high bits nudged left into another block
@@ -1736,6 +4230,14 @@ void BigInteger::operator =(const BigInteger &x) {
 	mag = x.mag;
 }
 
+void BigInteger::operator =(BigInteger &&x) {
+	if (this == &x)
+		return;
+	sign = x.sign;
+	mag = std::move(x.mag);
+	x.sign = zero;
+}
+
 BigInteger::BigInteger(const Blk *b, Index blen, Sign s) : mag(b, blen) {
 	switch (s) {
 	case zero:
@@ -1888,7 +4390,7 @@ BigInteger::CmpRes BigInteger::compareTo(const BigInteger &x) const {
 	if (cond) { \
 		BigInteger tmpThis; \
 		tmpThis.op; \
-		*this = tmpThis; \
+		*this = std::move(tmpThis); \
 		return; \
 	}
 
@@ -2183,23 +4685,597 @@ BigUnsigned modinv(const BigInteger &x, const BigUnsigned &n) {
 
 BigUnsigned modexp(const BigInteger &base, const BigUnsigned &exponent,
 		const BigUnsigned &modulus) {
+	// An odd modulus can use Montgomery multiplication.
+	if (modulus.getBit(0))
+		return modexp(base, exponent, MontgomeryContext(modulus));
+	// Otherwise reduce with Barrett; modulus 0 leaves nothing to reduce by.
+	if (modulus.isZero())
+		throw "modexp: The modulus must be nonzero";
+	BarrettContext context(modulus);
 	BigUnsigned ans = 1, base2 = (base % modulus).getMagnitude();
 	BigUnsigned::Index i = exponent.bitLength();
 	// For each bit of the exponent, most to least significant...
 	while (i > 0) {
 		i--;
 		// Square.
-		ans *= ans;
-		ans %= modulus;
+		context.square(ans, ans);
 		// And multiply if the bit is a 1.
-		if (exponent.getBit(i)) {
-			ans *= base2;
-			ans %= modulus;
+		if (exponent.getBit(i))
+			context.multiply(ans, ans, base2);
+	}
+	return ans;
+}
+
+MontgomeryContext::MontgomeryContext(const BigUnsigned &modulus)
+		: n(modulus), k(modulus.getLength()) {
+	if (!n.getBit(0))
+		throw "MontgomeryContext: The modulus must be odd";
+	/* Newton's iteration for the inverse of n mod 2^N: if x is correct to
+	 * j bits, x * (2 - n0 * x) is correct to 2j bits, and any odd n0 is its
+	 * own inverse to 3 bits. */
+	Blk n0 = n.blk[0], x = n0;
+	for (unsigned int bits = 3; bits < BigUnsigned::N; bits *= 2)
+		x *= 2 - n0 * x;
+	nInv = Blk(0) - x;
+	// R^2 mod n by the slow route, once.
+	rr = 1;
+	rr <<= int(2 * BigUnsigned::N * k);
+	rr %= n;
+	one = 1;
+	toMontgomery(one, one);
+}
+
+void MontgomeryContext::reduceBlocks(Blk *t) const {
+	Index i;
+	/* Each step adds the multiple of n that zeroes block i of t.  Adding
+	 * m * n at block i carries into the blocks above it, up to t[2k]. */
+	for (i = 0; i < k; i++) {
+		Blk m = t[i] * nInv;
+		Blk carry = BigUnsigned::mulAddBlocks(t + i, n.blk, k, m);
+		BigUnsigned::addBlockToBlocks(t + i + k, k + 1 - i, carry);
+	}
+	// The low k blocks are now zero and t / R < 2n sits in t[k, 2k].
+	Blk *u = t + k;
+	if (u[k] != 0 || BigUnsigned::compareBlocks(u, n.blk, k) != BigUnsigned::less)
+		BigUnsigned::subBlocks(u, u, n.blk, k);
+	for (i = 0; i < k; i++)
+		t[i] = u[i];
+}
+
+void MontgomeryContext::reduce(BigUnsigned &t) const {
+	Index i;
+	t.allocateAndCopy(2 * k + 1);
+	for (i = t.len; i < 2 * k + 1; i++)
+		t.blk[i] = 0;
+	reduceBlocks(t.blk);
+	t.len = k;
+	t.zapLeadingZeros();
+}
+
+void MontgomeryContext::toMontgomery(BigUnsigned &r, const BigUnsigned &a) const {
+	// REDC(a * R^2) = aR mod n, once a is below n.
+	if (a >= n) {
+		BigUnsigned a2(a);
+		a2 %= n;
+		multiply(r, a2, rr);
+	} else
+		multiply(r, a, rr);
+}
+
+void MontgomeryContext::fromMontgomery(BigUnsigned &r, const BigUnsigned &a) const {
+	r = a;
+	reduce(r);
+}
+
+void MontgomeryContext::multiply(BigUnsigned &r, const BigUnsigned &a,
+		const BigUnsigned &b) const {
+	BigUnsigned scratch;
+	multiply(r, a, b, scratch);
+}
+
+void MontgomeryContext::multiply(BigUnsigned &r, const BigUnsigned &a,
+		const BigUnsigned &b, BigUnsigned &scratch) const {
+	if (&r == &a || &r == &b) {
+		BigUnsigned tmp;
+		multiply(tmp, a, b, scratch);
+		r.swap(tmp);
+		return;
+	}
+	if (a.len == 0 || b.len == 0) {
+		r.len = 0;
+		return;
+	}
+	Index i, prodLen = a.len + b.len;
+	r.allocate(2 * k + 1);
+	scratch.allocate(BigUnsigned::multiplyScratchSize(a.len, b.len));
+	BigUnsigned::multiplyBlocks(r.blk, a.blk, a.len, b.blk, b.len,
+			scratch.blk);
+	for (i = prodLen; i < 2 * k + 1; i++)
+		r.blk[i] = 0;
+	reduceBlocks(r.blk);
+	r.len = k;
+	r.zapLeadingZeros();
+}
+
+void MontgomeryContext::square(BigUnsigned &r, const BigUnsigned &a) const {
+	BigUnsigned scratch;
+	square(r, a, scratch);
+}
+
+void MontgomeryContext::square(BigUnsigned &r, const BigUnsigned &a,
+		BigUnsigned &scratch) const {
+	if (&r == &a) {
+		BigUnsigned tmp;
+		square(tmp, a, scratch);
+		r.swap(tmp);
+		return;
+	}
+	if (a.len == 0) {
+		r.len = 0;
+		return;
+	}
+	Index i;
+	r.allocate(2 * k + 1);
+	scratch.allocate(BigUnsigned::squareScratchSize(a.len));
+	BigUnsigned::squareBlocks(r.blk, a.blk, a.len, scratch.blk);
+	for (i = 2 * a.len; i < 2 * k + 1; i++)
+		r.blk[i] = 0;
+	reduceBlocks(r.blk);
+	r.len = k;
+	r.zapLeadingZeros();
+}
+
+unsigned int ExponentRecoding::windowBitsFor(Index bitLength) {
+	// Where each width starts to beat the next smaller one.
+	return (bitLength > 671) ? maxWindowBits
+		: (bitLength > 239) ? 5
+		: (bitLength > 79) ? 4
+		: (bitLength > 23) ? 3
+		: 1;
+}
+
+ExponentRecoding::ExponentRecoding(const BigUnsigned &exponent) {
+	Index i = exponent.bitLength(), low, pending = 0;
+	windowBits = windowBitsFor(i);
+	/* Scan from the top.  A 0-bit just adds a squaring; a 1-bit starts a
+	 * window of up to windowBits bits that must also end in a 1-bit. */
+	while (i > 0) {
+		if (!exponent.getBit(i - 1)) {
+			pending++;
+			i--;
+			continue;
+		}
+		low = (i > windowBits) ? i - windowBits : 0;
+		while (!exponent.getBit(low))
+			low++;
+		Window w;
+		w.digit = 0;
+		for (Index bit = i; bit > low; bit--)
+			w.digit = (w.digit << 1) | (exponent.getBit(bit - 1) ? 1 : 0);
+		// The first window seeds the result, so it needs no squarings.
+		w.squarings = windows.empty() ? 0 : pending + (i - low);
+		windows.push_back(w);
+		pending = 0;
+		i = low;
+	}
+	if (pending > 0) {
+		Window w;
+		w.squarings = pending;
+		w.digit = 0;
+		windows.push_back(w);
+	}
+}
+
+BigUnsigned modexp(const BigInteger &base, const ExponentRecoding &exponent,
+		const MontgomeryContext &context) {
+	const BigUnsigned &modulus = context.getModulus();
+	// scratch serves every product, so the loop allocates nothing.
+	BigUnsigned ans, temp, scratch;
+	if (exponent.isZero()) {
+		context.fromMontgomery(ans, context.getOne());
+		return ans;
+	}
+	/* table[j] holds base^(2j + 1) in Montgomery form, for every odd power
+	 * a window can ask for. */
+	BigUnsigned table[1 << (ExponentRecoding::maxWindowBits - 1)];
+	ExponentRecoding::Index tableSize = 1 << (exponent.getWindowBits() - 1), i, j;
+	ExponentRecoding::Index steps = exponent.getWindowCount();
+	// toMontgomery reduces a nonnegative base itself.
+	BigUnsigned plain = (base.getSign() == BigInteger::negative)
+		? (base % modulus).getMagnitude() : base.getMagnitude();
+	context.toMontgomery(table[0], plain);
+	// See endsWithBase; multiply needs the base below n.
+	bool fold = exponent.endsWithBase() && plain < modulus;
+	if (fold)
+		steps--;
+	if (tableSize > 1) {
+		context.square(temp, table[0], scratch);
+		for (j = 1; j < tableSize; j++)
+			context.multiply(table[j], table[j - 1], temp, scratch);
+	}
+	// For each window, most to least significant...
+	ans = table[exponent.getWindow(0).digit >> 1];
+	for (i = 1; i < steps; i++) {
+		const ExponentRecoding::Window &w = exponent.getWindow(i);
+		// Square.  temp is the other half of ans.
+		for (j = 0; j < w.squarings; j++) {
+			context.square(temp, ans, scratch);
+			ans.swap(temp);
+		}
+		// And multiply by the window's power.
+		if (w.digit != 0) {
+			context.multiply(temp, ans, table[w.digit >> 1], scratch);
+			ans.swap(temp);
+		}
+	}
+	if (fold) {
+		for (j = 0; j < exponent.getWindow(steps).squarings; j++) {
+			context.square(temp, ans, scratch);
+			ans.swap(temp);
+		}
+		context.multiply(temp, ans, plain, scratch);
+	} else
+		context.fromMontgomery(temp, ans);
+	return temp;
+}
+
+BigUnsigned modexp(const BigInteger &base, const BigUnsigned &exponent,
+		const MontgomeryContext &context) {
+	return modexp(base, ExponentRecoding(exponent), context);
+}
+
+// MULTIBUFFERMONTGOMERY
+
+// The same steps on plain integers, one lane at a time
+struct MultiBufferMontgomery::ScalarOps {
+	enum { lanes = 1 };
+	typedef Digit V;
+	static void set1(V &r, Digit x) { r = x; }
+	static void load(V &r, const Digit *p) { r = *p; }
+	static void store(Digit *p, const V &x) { *p = x; }
+	static void add(V &r, const V &x, const V &y) { r = x + y; }
+	// The product of the low 32 bits of x and y, like the vector ones
+	static void mul(V &r, const V &x, const V &y) {
+		r = (x & 0xFFFFFFFFULL) * (y & 0xFFFFFFFFULL);
+	}
+	static void bitAnd(V &r, const V &x, const V &y) { r = x & y; }
+	static void shiftDigit(V &r, const V &x) { r = x >> digitBits; }
+};
+
+void MultiBufferMontgomery::multiplyScalar(Digit *r, const Digit *a,
+		const Digit *b, const Digit *n, Digit nInv, Index d, Digit *t) {
+	multiplyLanes<ScalarOps>(r, a, b, n, nInv, d, t);
+}
+
+#ifdef MULTIBUFFERMONTGOMERY_X86
+
+/* Each vector engine is compiled for its instruction set with a target
+ * attribute, and flatten pulls multiplyLanes and the Ops into it; only the
+ * engines the processor has are ever called. */
+#define MULTIBUFFERMONTGOMERY_OPS(Target) \
+	static inline __attribute__((target(Target)))
+
+struct MultiBufferMontgomery::AVX2Ops {
+	enum { lanes = 4 };
+	typedef __m256i V;
+	MULTIBUFFERMONTGOMERY_OPS("avx2") void set1(V &r, Digit x) {
+		r = _mm256_set1_epi64x((long long)x);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx2") void load(V &r, const Digit *p) {
+		r = _mm256_loadu_si256((const __m256i *)p);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx2") void store(Digit *p, const V &x) {
+		_mm256_storeu_si256((__m256i *)p, x);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx2") void add(V &r, const V &x, const V &y) {
+		r = _mm256_add_epi64(x, y);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx2") void mul(V &r, const V &x, const V &y) {
+		r = _mm256_mul_epu32(x, y);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx2") void bitAnd(V &r, const V &x, const V &y) {
+		r = _mm256_and_si256(x, y);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx2") void shiftDigit(V &r, const V &x) {
+		r = _mm256_srli_epi64(x, digitBits);
+	}
+};
+
+struct MultiBufferMontgomery::AVX512Ops {
+	enum { lanes = 8 };
+	typedef __m512i V;
+	MULTIBUFFERMONTGOMERY_OPS("avx512f") void set1(V &r, Digit x) {
+		r = _mm512_set1_epi64((long long)x);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx512f") void load(V &r, const Digit *p) {
+		r = _mm512_loadu_si512((const void *)p);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx512f") void store(Digit *p, const V &x) {
+		_mm512_storeu_si512((void *)p, x);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx512f") void add(V &r, const V &x, const V &y) {
+		r = _mm512_add_epi64(x, y);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx512f") void mul(V &r, const V &x, const V &y) {
+		r = _mm512_mul_epu32(x, y);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx512f") void bitAnd(V &r, const V &x, const V &y) {
+		r = _mm512_and_si512(x, y);
+	}
+	MULTIBUFFERMONTGOMERY_OPS("avx512f") void shiftDigit(V &r, const V &x) {
+		r = _mm512_srli_epi64(x, digitBits);
+	}
+};
+
+#undef MULTIBUFFERMONTGOMERY_OPS
+
+__attribute__((target("avx2"), flatten))
+void MultiBufferMontgomery::multiplyAVX2(Digit *r, const Digit *a,
+		const Digit *b, const Digit *n, Digit nInv, Index d, Digit *t) {
+	multiplyLanes<AVX2Ops>(r, a, b, n, nInv, d, t);
+}
+
+__attribute__((target("avx512f"), flatten))
+void MultiBufferMontgomery::multiplyAVX512(Digit *r, const Digit *a,
+		const Digit *b, const Digit *n, Digit nInv, Index d, Digit *t) {
+	multiplyLanes<AVX512Ops>(r, a, b, n, nInv, d, t);
+}
+
+#endif
+
+MultiBufferMontgomery::MultiBufferMontgomery(const BigUnsigned &modulus,
+		unsigned int laneLimit) : n(modulus) {
+	if (!n.getBit(0))
+		throw "MultiBufferMontgomery: The modulus must be odd";
+	// R = 2^(digitBits * d) > 4n
+	d = (n.bitLength() + 2 + digitBits - 1) / digitBits;
+	// Newton's iteration for n^(-1), as in MontgomeryContext
+	Digit n0 = n.getBlock(0), x = n0;
+	for (unsigned int bits = 3; bits < digitBits; bits *= 2)
+		x *= 2 - n0 * x;
+	nInv = (Digit(0) - x) & ((Digit(1) << digitBits) - 1);
+	lanes = 1;
+	mul = &multiplyScalar;
+#ifdef MULTIBUFFERMONTGOMERY_X86
+	if (laneLimit >= 8 && __builtin_cpu_supports("avx512f")) {
+		lanes = 8;
+		mul = &multiplyAVX512;
+	} else if (laneLimit >= 4 && __builtin_cpu_supports("avx2")) {
+		lanes = 4;
+		mul = &multiplyAVX2;
+	}
+#else
+	(void)laneLimit;
+#endif
+	nd.resize(d);
+	toDigits(&nd[0], 1, d, n);
+	BigUnsigned r2(1);
+	r2 <<= int(2 * digitBits * d);
+	r2 %= n;
+	rr.resize(d);
+	toDigits(&rr[0], 1, d, r2);
+}
+
+void MultiBufferMontgomery::toDigits(Digit *x, Index stride, Index d,
+		const BigUnsigned &a) {
+	const Digit mask = (Digit(1) << digitBits) - 1;
+	// acc holds the accBits bits of a that haven't gone into a digit yet.
+	BigUnsigned::Blk acc = 0;
+	unsigned int accBits = 0;
+	Index blockNum = 0;
+	for (Index j = 0; j < d; j++) {
+		if (accBits >= digitBits) {
+			x[j * stride] = acc & mask;
+			acc >>= digitBits;
+			accBits -= digitBits;
+		} else {
+			BigUnsigned::Blk next = a.getBlock(blockNum++);
+			x[j * stride] = (acc | (next << accBits)) & mask;
+			acc = next >> (digitBits - accBits);
+			accBits += BigUnsigned::N - digitBits;
 		}
 	}
+}
+
+BigUnsigned MultiBufferMontgomery::fromDigits(const Digit *x, Index stride,
+		Index d) {
+	BigUnsigned ans(0, (d * digitBits + BigUnsigned::N - 1) / BigUnsigned::N);
+	BigUnsigned::Blk acc = 0;
+	unsigned int accBits = 0;
+	Index blockNum = 0;
+	for (Index j = 0; j < d; j++) {
+		acc |= BigUnsigned::Blk(x[j * stride]) << accBits;
+		accBits += digitBits;
+		if (accBits >= BigUnsigned::N) {
+			ans.blk[blockNum++] = acc;
+			accBits -= BigUnsigned::N;
+			acc = (accBits == 0) ? 0
+				: BigUnsigned::Blk(x[j * stride]) >> (digitBits - accBits);
+		}
+	}
+	if (accBits > 0)
+		ans.blk[blockNum++] = acc;
+	ans.len = blockNum;
+	ans.zapLeadingZeros();
 	return ans;
 }
 
+void MultiBufferMontgomery::modexp(BigUnsigned *results,
+		const BigUnsigned *bases, Index count,
+		const ExponentRecoding &exponent) const {
+	if (d == 0)
+		throw "MultiBufferMontgomery::modexp: The engine is empty";
+	Index i, j, lane;
+	if (exponent.isZero()) {
+		for (i = 0; i < count; i++)
+			results[i] = (n == 1) ? BigUnsigned(0) : BigUnsigned(1);
+		return;
+	}
+	const Index L = lanes, size = d * L;
+	Index tableSize = 1 << (exponent.getWindowBits() - 1);
+	// The bases are always reduced, so see endsWithBase.
+	Index steps = exponent.getWindowCount() - (exponent.endsWithBase() ? 1 : 0);
+	/* The table of odd powers, the answer, the bases, the broadcast R^2
+	 * and 1 for going in and out of Montgomery form, and the
+	 * multiplication's scratch space, all d digits of L lanes. */
+	std::vector<Digit> space((tableSize + 5) * size);
+	Digit *table = &space[0], *ans = table + tableSize * size;
+	Digit *plain = ans + size, *rrLanes = plain + size;
+	Digit *oneLanes = rrLanes + size, *scratch = oneLanes + size;
+	for (j = 0; j < d; j++)
+		for (lane = 0; lane < L; lane++) {
+			rrLanes[j * L + lane] = rr[j];
+			oneLanes[j * L + lane] = (j == 0) ? 1 : 0;
+		}
+	for (Index first = 0; first < count; first += L) {
+		// Load the next L bases, padding the last pass with zeros.
+		for (lane = 0; lane < L; lane++) {
+			if (first + lane >= count)
+				toDigits(plain + lane, L, d, BigUnsigned(0));
+			else if (bases[first + lane] < n)
+				toDigits(plain + lane, L, d, bases[first + lane]);
+			else
+				toDigits(plain + lane, L, d, bases[first + lane] % n);
+		}
+		// table[j] holds base^(2j + 1) in Montgomery form.
+		mul(table, plain, rrLanes, &nd[0], nInv, d, scratch);
+		if (tableSize > 1) {
+			mul(ans, table, table, &nd[0], nInv, d, scratch);
+			for (j = 1; j < tableSize; j++)
+				mul(table + j * size, table + (j - 1) * size, ans,
+					&nd[0], nInv, d, scratch);
+		}
+		// For each window, most to least significant...
+		const Digit *start = table + (exponent.getWindow(0).digit >> 1) * size;
+		for (j = 0; j < size; j++)
+			ans[j] = start[j];
+		for (i = 1; i < steps; i++) {
+			const ExponentRecoding::Window &w = exponent.getWindow(i);
+			// Square...
+			for (j = 0; j < w.squarings; j++)
+				mul(ans, ans, ans, &nd[0], nInv, d, scratch);
+			// ...and multiply by the window's power.
+			if (w.digit != 0)
+				mul(ans, ans, table + (w.digit >> 1) * size,
+					&nd[0], nInv, d, scratch);
+		}
+		/* Out of Montgomery form, which leaves each lane below 2n (at most
+		 * n when multiplying by 1). */
+		if (steps < exponent.getWindowCount()) {
+			for (j = 0; j < exponent.getWindow(steps).squarings; j++)
+				mul(ans, ans, ans, &nd[0], nInv, d, scratch);
+			mul(ans, ans, plain, &nd[0], nInv, d, scratch);
+		} else
+			mul(ans, ans, oneLanes, &nd[0], nInv, d, scratch);
+		for (lane = 0; lane < L && first + lane < count; lane++) {
+			results[first + lane] = fromDigits(ans + lane, L, d);
+			if (results[first + lane] >= n)
+				results[first + lane] -= n;
+		}
+	}
+}
+
+void modexpBatch(BigUnsigned *results, const BigUnsigned *bases,
+		BigUnsigned::Index count, const ExponentRecoding &exponent,
+		const MultiBufferMontgomery &multi, const MontgomeryContext &context,
+		ModexpFunction single) {
+	BigUnsigned::Index batched = 0, lanes = multi.getLanes();
+	if (lanes > 1) {
+		/* A pass costs a few single exponentiations, so a pass that is
+		 * more than half padding is left to single. */
+		batched = count - count % lanes;
+		if (count % lanes > lanes / 2)
+			batched = count;
+		multi.modexp(results, bases, batched, exponent);
+	}
+	for (BigUnsigned::Index i = batched; i < count; i++)
+		results[i] = single(bases[i], exponent, context);
+}
+
+void modexpBatch(BigUnsigned *results, const BigUnsigned *bases,
+		BigUnsigned::Index count, const BigUnsigned &exponent,
+		const BigUnsigned &modulus) {
+	if (modulus.isZero())
+		throw "modexpBatch: The modulus must be nonzero";
+	if (modulus.getBit(0) == 0) {
+		// Neither engine works with an even modulus.
+		for (BigUnsigned::Index i = 0; i < count; i++)
+			results[i] = modexp(bases[i], exponent, modulus);
+		return;
+	}
+	MontgomeryContext context(modulus);
+	ExponentRecoding windows(exponent);
+	MultiBufferMontgomery multi;
+	if (count > 1)
+		multi = MultiBufferMontgomery(modulus);
+	modexpBatch(results, bases, count, windows, multi, context);
+}
+
+
+BarrettContext::BarrettContext(const BigUnsigned &modulus)
+		: n(modulus), k(modulus.getLength()) {
+	if (n.isZero())
+		throw "BarrettContext: The modulus must be nonzero";
+	// mu = floor(b^(2k) / n), by the slow route, once.
+	BigUnsigned q;
+	mu = 1;
+	mu <<= int(2 * BigUnsigned::N * k);
+	mu.divideWithRemainder(n, q);
+	mu = q;
+}
+
+void BarrettContext::reduce(BigUnsigned &x) const {
+	if (x.len > 2 * k) {
+		x %= n;
+		return;
+	}
+	if (x.len < k || (x.len == k && x < n))
+		return;
+	Index i;
+	/* q1 = floor(x / b^(k-1)) and q3 = floor(q1 * mu / b^(k+1)).  q3 is
+	 * floor(x / n) or a little less, so x - q3 * n is small. */
+	const BigUnsigned::Blk *q1 = x.blk + (k - 1);
+	Index q1Len = x.len - (k - 1);
+	Index q2Len = q1Len + mu.len;
+	BigUnsigned scratch(0, q2Len + (q2Len - (k + 1)) + k);
+	Blk *q2 = scratch.blk;
+	BigUnsigned::multiplyBlocksBasecase(q2, q1, q1Len, mu.blk, mu.len);
+	const Blk *q3 = q2 + (k + 1);
+	Index q3Len = q2Len - (k + 1);
+	while (q3Len > 0 && q3[q3Len - 1] == 0)
+		q3Len--;
+	// x mod b^(k+1) minus (q3 * n) mod b^(k+1), wrapping mod b^(k+1).
+	x.allocateAndCopy(k + 1);
+	for (i = x.len; i < k + 1; i++)
+		x.blk[i] = 0;
+	if (q3Len > 0) {
+		Blk *r2 = q2 + q2Len;
+		BigUnsigned::multiplyBlocksBasecase(r2, q3, q3Len, n.blk, k);
+		Index r2Len = (q3Len + k < k + 1) ? q3Len + k : k + 1;
+		Blk borrow = BigUnsigned::subBlocks(x.blk, x.blk, r2, r2Len);
+		BigUnsigned::subBlockFromBlocks(x.blk + r2Len, k + 1 - r2Len, borrow);
+	}
+	x.len = k + 1;
+	x.zapLeadingZeros();
+	// The estimate q3 is at most two short.
+	while (x >= n) {
+		Blk borrow = BigUnsigned::subBlocks(x.blk, x.blk, n.blk, k);
+		BigUnsigned::subBlockFromBlocks(x.blk + k, x.len - k, borrow);
+		x.zapLeadingZeros();
+	}
+}
+
+void BarrettContext::multiply(BigUnsigned &r, const BigUnsigned &a,
+		const BigUnsigned &b) const {
+	r.multiply(a, b);
+	reduce(r);
+}
+
+void BarrettContext::square(BigUnsigned &r, const BigUnsigned &a) const {
+	r.square(a);
+	reduce(r);
+}
+
 
 
 BigUnsignedInABase::BigUnsignedInABase(const Digit *d, Index l, Base base)
@@ -2229,6 +5305,10 @@ namespace {
 	unsigned int ceilingDiv(unsigned int a, unsigned int b) {
 		return (a + b - 1) / b;
 	}
+	// Returns k if base is 2^k, or 0 if it isn't a power of two.
+	unsigned int powerOfTwoBits(unsigned int base) {
+		return (base & (base - 1)) == 0 ? bitLen(base) - 1 : 0;
+	}
 }
 
 BigUnsignedInABase::BigUnsignedInABase(const BigUnsigned &x, Base base) {
@@ -2237,6 +5317,32 @@ BigUnsignedInABase::BigUnsignedInABase(const BigUnsigned &x, Base base) {
 		throw "BigUnsignedInABase(BigUnsigned, Base): The base must be at least 2";
 	this->base = base;
 
+	/* A power-of-two base just slices the bits of x into k-bit digits, so
+	 * there is no need to divide. */
+	unsigned int k = powerOfTwoBits(base);
+	if (k != 0) {
+		len = ceilingDiv(x.bitLength(), k);
+		allocate(len);
+		// acc holds the accBits bits of x that haven't gone into a digit yet.
+		BigUnsigned::Blk acc = 0;
+		unsigned int accBits = 0;
+		Index blockNum = 0;
+		for (Index digitNum = 0; digitNum < len; digitNum++) {
+			if (accBits >= k) {
+				blk[digitNum] = Digit(acc & (base - 1));
+				acc >>= k;
+				accBits -= k;
+			} else {
+				// The digit straddles the next block.
+				BigUnsigned::Blk next = x.getBlock(blockNum++);
+				blk[digitNum] = Digit((acc | (next << accBits)) & (base - 1));
+				acc = next >> (k - accBits);
+				accBits += BigUnsigned::N - k;
+			}
+		}
+		return;
+	}
+
 	// Get an upper bound on how much space we need
 	int maxBitLenOfX = x.getLength() * BigUnsigned::N;
 	int minBitsPerDigit = bitLen(base) - 1;
@@ -2262,12 +5368,37 @@ BigUnsignedInABase::BigUnsignedInABase(const BigUnsigned &x, Base base) {
 }
 
 BigUnsignedInABase::operator BigUnsigned() const {
-	BigUnsigned ans(0), buBase(base), temp;
+	// Power-of-two bases pack the digits straight into blocks.
+	unsigned int k = powerOfTwoBits(base);
+	if (k != 0) {
+		BigUnsigned ans(0, ceilingDiv(len * k, BigUnsigned::N));
+		BigUnsigned::Blk acc = 0;
+		unsigned int accBits = 0;
+		Index blockNum = 0;
+		for (Index digitNum = 0; digitNum < len; digitNum++) {
+			acc |= BigUnsigned::Blk(blk[digitNum]) << accBits;
+			accBits += k;
+			if (accBits >= BigUnsigned::N) {
+				// The block is full; the rest of the digit starts the next one.
+				ans.blk[blockNum++] = acc;
+				accBits -= BigUnsigned::N;
+				acc = (accBits == 0) ? 0
+					: BigUnsigned::Blk(blk[digitNum]) >> (k - accBits);
+			}
+		}
+		if (accBits > 0)
+			ans.blk[blockNum++] = acc;
+		ans.len = blockNum;
+		ans.zapLeadingZeros();
+		return ans;
+	}
+
+	// Horner's rule, one pass over ans per digit.
+	BigUnsigned ans(0), buBase(base);
 	Index digitNum = len;
 	while (digitNum > 0) {
 		digitNum--;
-		temp.multiply(ans, buBase);
-		ans.add(temp, BigUnsigned(blk[digitNum]));
+		ans.multiplyAdd(ans, buBase, BigUnsigned(blk[digitNum]));
 	}
 	return ans;
 }
@@ -2328,8 +5459,91 @@ BigUnsignedInABase::operator std::string() const {
 
 
 
+/* Decimal conversion works divide-and-conquer style on chunks of decimal
+ * digits that fit in a block.  With c = 10^chunkDigits and powers[i] =
+ * c^(2^i), a number below powers[i]^2 splits into a high and a low half at
+ * powers[i], and each half is converted the same way one level down; at
+ * the bottom, single-block chunks are converted with word arithmetic.  The
+ * halving means most of the work is in a few large multiplications or
+ * divisions instead of one small division for every digit. */
+namespace {
+	// The most decimal digits that always fit in a block
+	const unsigned int chunkDigits = (sizeof(BigUnsigned::Blk) >= 8) ? 19 : 9;
+
+	/* Fills powers with c^(2^i) for i = 0, 1, ... until the last one, when
+	 * squared, is at least 2^bits. */
+	void decimalPowers(std::vector<BigUnsigned> &powers, BigUnsigned::Index bits) {
+		BigUnsigned::Blk c = 1;
+		for (unsigned int i = 0; i < chunkDigits; i++)
+			c *= 10;
+		powers.push_back(BigUnsigned(c));
+		while (bits > 2 * (powers.back().bitLength() - 1)) {
+			BigUnsigned next;
+			next.square(powers.back());
+			powers.push_back(next);
+		}
+	}
+
+	/* Appends the decimal digits of x < powers[level]^2 (or x < c if level
+	 * is -1) to out.  If pad is set, leading zeros are added to make
+	 * chunkDigits * 2^(level + 1) digits. */
+	void appendDecimal(std::string &out, const BigUnsigned &x, int level,
+			bool pad, const std::vector<BigUnsigned> &powers) {
+		if (level < 0) {
+			BigUnsigned::Blk v = x.getBlock(0);
+			char digits[chunkDigits];
+			unsigned int n = 0;
+			do {
+				digits[n++] = char('0' + v % 10);
+				v /= 10;
+			} while (v != 0);
+			if (pad)
+				while (n < chunkDigits)
+					digits[n++] = '0';
+			while (n > 0)
+				out += digits[--n];
+			return;
+		}
+		// With no padding, a number with no high half skips the division.
+		if (!pad && x < powers[level]) {
+			appendDecimal(out, x, level - 1, false, powers);
+			return;
+		}
+		BigUnsigned q, r(x);
+		r.divideWithRemainder(powers[level], q);
+		appendDecimal(out, q, level - 1, pad, powers);
+		appendDecimal(out, r, level - 1, true, powers);
+	}
+
+	/* Parses the decimal digits s[begin, end), of which there are at most
+	 * chunkDigits * 2^(level + 1). */
+	BigUnsigned parseDecimal(const std::string &s, std::size_t begin,
+			std::size_t end, int level, const std::vector<BigUnsigned> &powers) {
+		if (level < 0) {
+			BigUnsigned::Blk v = 0;
+			for (std::size_t i = begin; i < end; i++)
+				v = v * 10 + BigUnsigned::Blk(s[i] - '0');
+			return BigUnsigned(v);
+		}
+		std::size_t lowDigits = std::size_t(chunkDigits) << level;
+		if (end - begin <= lowDigits)
+			return parseDecimal(s, begin, end, level - 1, powers);
+		BigUnsigned ans;
+		ans.multiply(parseDecimal(s, begin, end - lowDigits, level - 1, powers),
+			powers[level]);
+		ans += parseDecimal(s, end - lowDigits, end, level - 1, powers);
+		return ans;
+	}
+}
+
 std::string bigUnsignedToString(const BigUnsigned &x) {
-	return std::string(BigUnsignedInABase(x, 10));
+	if (x.isZero())
+		return std::string("0");
+	std::vector<BigUnsigned> powers;
+	decimalPowers(powers, x.bitLength());
+	std::string s;
+	appendDecimal(s, x, int(powers.size()) - 1, false, powers);
+	return s;
 }
 
 std::string bigIntegerToString(const BigInteger &x) {
@@ -2339,7 +5553,16 @@ std::string bigIntegerToString(const BigInteger &x) {
 }
 
 BigUnsigned stringToBigUnsigned(const std::string &s) {
-	return BigUnsigned(BigUnsignedInABase(s, 10));
+	for (std::size_t i = 0; i < s.length(); i++)
+		if (s[i] < '0' || s[i] > '9')
+			// Let the general routine report the bad symbol.
+			return BigUnsigned(BigUnsignedInABase(s, 10));
+	if (s.empty())
+		return BigUnsigned();
+	// Each decimal digit is a little under 3.33 bits.
+	std::vector<BigUnsigned> powers;
+	decimalPowers(powers, BigUnsigned::Index(s.length() / 3 * 10 + 10));
+	return parseDecimal(s, 0, s.length(), int(powers.size()) - 1, powers);
 }
 
 BigInteger stringToBigInteger(const std::string &s) {
@@ -2364,7 +5587,8 @@ std::ostream &operator <<(std::ostream &os, const BigUnsigned &x) {
 			os << '0';
 	} else
 		throw "std::ostream << BigUnsigned: Could not determine the desired base from output-stream flags";
-	std::string s = std::string(BigUnsignedInABase(x, base));
+	std::string s = (base == 10) ? bigUnsignedToString(x)
+		: std::string(BigUnsignedInABase(x, base));
 	os << s;
 	return os;
 }
@@ -2,12 +2,13 @@
 #include <string>
 #include <ctime>
 #include <chrono>
+#include <iomanip>
 #include "RSA_enc.cpp"
 
 using namespace std;
 using namespace std::chrono;
 
-string ERROR_INVALID_ARGS = "You must provide all arguments in the specified order. For example:\nrsa -e -k key_components.txt -f filename.ext -o outfilename.ext\n\nYou can also run a test by calling:\nrsa -t -k key_components.txt -f filename.ext\n\n";
+string ERROR_INVALID_ARGS = "You must provide all arguments in the specified order. For example:\nrsa -e -k key_components.txt -f filename.ext -o outfilename.ext\n\nYou can also run a test by calling:\nrsa -t -k key_components.txt -f filename.ext\n\nor time the multiplication algorithms with:\nrsa -b\n\n";
 
 int runTestCase(string keyfile, string testfile) {
     int filenamestartindex = -1;
@@ -88,6 +89,102 @@ int runTestCase(string keyfile, string testfile) {
     return 1;
 }
 
+/**
+ * Returns the time, in nanoseconds, of one multiply a * b averaged over
+ * reps repetitions.
+ */
+double timeMultiply(const BigUnsigned &a, const BigUnsigned &b, int reps) {
+    BigUnsigned p;
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    for (int i = 0; i < reps; i++)
+        p.multiply(a, b);
+    high_resolution_clock::time_point stop = high_resolution_clock::now();
+    return double(duration_cast< nanoseconds >(stop - start).count()) / reps;
+}
+
+/**
+ * Times BigUnsigned::multiply on balanced operands of increasing size with
+ * the schoolbook method, Karatsuba and Toom-3, and reports the size from
+ * which each one stays ahead of the one below it.  Karatsuba and Toom-3
+ * are timed as one level of splitting on top of the current thresholds,
+ * so the crossovers are what BigUnsigned::karatsubaThreshold and
+ * BigUnsigned::toom3Threshold (or the BIGUNSIGNED_KARATSUBA_THRESHOLD and
+ * BIGUNSIGNED_TOOM3_THRESHOLD macros) should be set to on this machine.
+ */
+int runMultiplyBenchmark() {
+    const BigUnsigned::Index sizes[] = { 8, 12, 16, 24, 32, 48, 64, 96, 128,
+        160, 192, 256, 384, 512 };
+    const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+    const BigUnsigned::Index never = ~BigUnsigned::Index(0);
+    BigUnsigned::Index karatsubaThreshold = BigUnsigned::karatsubaThreshold;
+    BigUnsigned::Index toom3Threshold = BigUnsigned::toom3Threshold;
+    double schoolbook[numSizes], karatsuba[numSizes], toom3[numSizes];
+
+    cout << "Current thresholds: Karatsuba " << karatsubaThreshold
+        << " blocks, Toom-3 " << toom3Threshold << " blocks\n\n";
+    cout << "   bits  blocks   schoolbook    karatsuba       toom-3  (ns per multiply)\n";
+    for (int i = 0; i < numSizes; i++) {
+        BigUnsigned::Index n = sizes[i];
+        int bytes = n * sizeof(BigUnsigned::Blk);
+        unsigned char *bytearray = new unsigned char[bytes];
+        BigUnsigned a, b;
+        for (int j = 0; j < bytes; j++)
+            bytearray[j] = rand();
+        bytearray[0] |= 0x80;
+        byteArrayToBigInt(a, bytearray, bytes);
+        for (int j = 0; j < bytes; j++)
+            bytearray[j] = rand();
+        bytearray[0] |= 0x80;
+        byteArrayToBigInt(b, bytearray, bytes);
+        delete [] bytearray;
+
+        // Enough repetitions for a run of about a millisecond
+        int reps = 1;
+        while (timeMultiply(a, b, reps) * reps < 1e6)
+            reps *= 2;
+        /* Take the best of many runs, alternating between the methods, so
+         * that interruptions and frequency changes affect them alike. */
+        for (int run = 0; run < 50; run++) {
+            BigUnsigned::karatsubaThreshold = never;
+            BigUnsigned::toom3Threshold = never;
+            double t = timeMultiply(a, b, reps);
+            if (run == 0 || t < schoolbook[i])
+                schoolbook[i] = t;
+            BigUnsigned::karatsubaThreshold = min(n, karatsubaThreshold);
+            t = timeMultiply(a, b, reps);
+            if (run == 0 || t < karatsuba[i])
+                karatsuba[i] = t;
+            BigUnsigned::karatsubaThreshold = karatsubaThreshold;
+            BigUnsigned::toom3Threshold = n;
+            t = timeMultiply(a, b, reps);
+            if (run == 0 || t < toom3[i])
+                toom3[i] = t;
+            BigUnsigned::toom3Threshold = toom3Threshold;
+        }
+
+        cout << fixed << setprecision(0) << setw(7) << n * BigUnsigned::N
+            << setw(8) << n << setw(13) << schoolbook[i] << setw(13)
+            << karatsuba[i] << setw(13) << toom3[i] << endl;
+    }
+
+    // A crossover is the smallest size from which the faster method wins.
+    int karatsubaFrom = numSizes, toom3From = numSizes;
+    while (karatsubaFrom > 0 && karatsuba[karatsubaFrom - 1] < schoolbook[karatsubaFrom - 1])
+        karatsubaFrom--;
+    while (toom3From > 0 && toom3[toom3From - 1] < karatsuba[toom3From - 1])
+        toom3From--;
+    cout << endl;
+    if (karatsubaFrom < numSizes)
+        cout << "Karatsuba beats the schoolbook method from " << sizes[karatsubaFrom] << " blocks\n";
+    else
+        cout << "Karatsuba does not beat the schoolbook method at " << sizes[numSizes - 1] << " blocks\n";
+    if (toom3From < numSizes)
+        cout << "Toom-3 beats Karatsuba from " << sizes[toom3From] << " blocks\n";
+    else
+        cout << "Toom-3 does not beat Karatsuba at " << sizes[numSizes - 1] << " blocks\n";
+    return 1;
+}
+
 /**
  * rsa -- encrypt or decrypt a file using rsa
  * 
@@ -101,6 +198,10 @@ int runTestCase(string keyfile, string testfile) {
  * 
  * -t   Run a test case
  * 
+ * rsa [-b]
+ * 
+ * -b   Time the multiplication algorithms and report their crossovers
+ * 
  **/ 
 int main(int argc, char** argv) {
 
@@ -115,6 +216,8 @@ int main(int argc, char** argv) {
             decrypt = true;
             return runTestCase(argv[3], argv[5]);
     }
+    if (argc == 2 && strcmp(argv[1], "-b") == 0)
+        return runMultiplyBenchmark();
     if (argc < 8) {
         ERROR(ERROR_INVALID_ARGS);
         return 0;
@@ -4,6 +4,7 @@
 #include <math.h>
 #include <cstring>
 #include <string>
+#include <algorithm>
 
 #include "BigInteger.hpp"
 
@@ -136,21 +137,7 @@ string charToBinaryString(unsigned char b) {
  */ 
 int bigIntToByteArray(BigUnsigned& b, unsigned char* bytearray, int bytelength) {
     if (b == 0) return 0;
-    string binstring = bigIntToBinaryString(b);
-    for (int i = bytelength - 1; i > 0; i--){
-        int len = binstring.length();
-        if (len > 8) { // more than 8 digits left
-            bytearray[i] = stoi(binstring.substr(len - 8), 0, 2);
-            binstring = binstring.substr(0, len - 8);
-        } else if (len > 0) {
-            bytearray[i] = stoi(binstring, 0, 2);
-            binstring = "";
-        } else {
-            bytearray[i] = 0;
-        }
-    }
-    if (binstring.length() > 0)
-        bytearray[0] = stoi(binstring, 0, 2);
+    b.toBytesBE(bytearray, bytelength);
     return bytelength;
 }
 
@@ -162,12 +149,7 @@ int bigIntToByteArray(BigUnsigned& b, unsigned char* bytearray, int bytelength)
  * 
  */ 
 int byteArrayToBigInt(BigUnsigned& b, unsigned char* bytearray, int bytelength) {
-    b = 0;
-    BigUnsigned power = 1;
-    for (int i = bytelength - 1; i >= 0; i--) {
-        b += power * bytearray[i];
-        power *= 256;
-    }
+    b = BigUnsigned::fromBytesBE(bytearray, bytelength);
     return bytelength;
 }
 